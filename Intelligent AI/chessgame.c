@@ -14,29 +14,29 @@
 
 int main(void)
 {
+	ChessGame *game = createChessGame();
 	ch_template chess_board[8][8];
 	char *playerInput = NULL, start_move[3], end_move[3];
-	initChessboard(chess_board);
+	initChessboard(game, chess_board);
 	int round = WHITE, total_rounds = 1;
 	bool pr_moves = false;
 	char *test_moves[] = {"h2h4", "b7b5", "h4h5"};
-	KingState BlackKing,WhiteKing;
 
 	start_move[2] = '\0';
 	end_move[2] = '\0';
 	for (;;) {
-		deleteMoves();
-		getAllMoves(chess_board, round);
-		if (BlackKing == checkmate || WhiteKing == checkmate)
+		deleteMoves(game);
+		getAllMoves(game, chess_board, round);
+		if (getKingState(game, BLACK) == checkmate || getKingState(game, WHITE) == checkmate)
 			break;
 		if (total_rounds > TEST_ROUNDS) {
 			clear_screen();
 			//printBoard(chess_board, 'l');
 			if (pr_moves) {
 				printf("\t\t\t***WHITE MOVES***\n");
-				printWhiteMoves();
+				printWhiteMoves(game);
 				printf("\t\t\t***BLACK MOVES***\n");
-				printBlackMoves();
+				printBlackMoves(game);
 				pr_moves = false;
 			}
 			if (round == WHITE)
@@ -50,7 +50,8 @@ int main(void)
 				if (!strncmp(playerInput, "quit", 4) || !strncmp(playerInput, "exit", 4)) {
 					free(playerInput);
 					playerInput = NULL;
-					deleteMoves();
+					deleteMoves(game);
+					deleteChessGame(game);
 					return 0;
 				}
 			} else if (strlen(playerInput) == 1) {
@@ -74,7 +75,7 @@ int main(void)
 			end_move[0] = test_moves[total_rounds-1][2];
 			end_move[1] = test_moves[total_rounds-1][3];
 		}
-		if (makeMove(chess_board, start_move, end_move, round)) {
+		if (makeMove(game, chess_board, start_move, end_move, round)) {
 			round = (round == BLACK)?WHITE:BLACK;
 			total_rounds++;
 		}
@@ -84,10 +85,11 @@ int main(void)
 	clear_screen();
 	//printBoard(chess_board, 'l');
 	pr_moves = false;
-	if (BlackKing == checkmate)
+	if (getKingState(game, BLACK) == checkmate)
 		printf("White wins!\n");
-	if (WhiteKing == checkmate)
+	if (getKingState(game, WHITE) == checkmate)
 		printf("Black wins!\n");
+	deleteChessGame(game);
 	return 0;
 }
 
@@ -0,0 +1,330 @@
+/*********************************************************************
+ *                         chesslib-bitboard.c                       *
+ *          bitboard position representation used by chesslib        *
+ *                                                                   *
+ *               (C)2015 <georgekoskerid@outlook.com>                *
+ *                                                                   *
+ *********************************************************************/
+
+#include "chesslib-bitboard.h"
+
+/*ray directions; the first four walk towards higher square numbers*/
+enum {
+	DIR_S,	/*towards rank 1*/
+	DIR_E,
+	DIR_SE,
+	DIR_SW,
+	DIR_N,	/*towards rank 8*/
+	DIR_W,
+	DIR_NE,
+	DIR_NW,
+	DIR_COUNT
+};
+
+
+/*********
+ *globals*
+ *********/
+
+static Bitboard knight_attacks[64];
+static Bitboard king_attacks[64];
+static Bitboard pawn_attacks[2][64];
+static Bitboard rays[DIR_COUNT][64];
+static Bitboard between[64][64];	/*squares strictly between two squares on a common line*/
+static Bitboard line[64][64];	/*the whole rank, file or diagonal through two squares*/
+
+
+/******************************************************
+ *prototypes for functions used in chesslib-bitboard.c*
+ ******************************************************/
+
+void __attribute__((constructor)) _bbInitTables();
+Bitboard _bbRayAttacks(const int dir, const int sq, const Bitboard occ);
+int _bbPieceOn(const Position *pos, const int sq, const int side);
+
+
+void _bbInitTables()
+{
+	const int row_step[DIR_COUNT] = {1, 0, 1, 1, -1, 0, -1, -1};
+	const int col_step[DIR_COUNT] = {0, 1, 1, -1, 0, -1, 1, -1};
+	const int knight_row[8] = {-2, -2, -1, -1, 1, 1, 2, 2};
+	const int knight_col[8] = {-1, 1, -2, 2, -2, 2, -1, 1};
+	const int opposite[DIR_COUNT] = {DIR_N, DIR_W, DIR_NW, DIR_NE, DIR_S, DIR_E, DIR_SW, DIR_SE};
+
+	for (int sq = 0; sq < 64; sq++) {
+		int row = BB_ROW(sq), col = BB_COL(sq);
+
+		for (int i = 0; i < 8; i++) {
+			int k = row + knight_row[i], l = col + knight_col[i];
+			if (k >= 0 && k <= 7 && l >= 0 && l <= 7)
+				knight_attacks[sq] |= BB_BIT(BB_SQUARE(k, l));
+		}
+		for (int dir = 0; dir < DIR_COUNT; dir++) {
+			int k = row + row_step[dir], l = col + col_step[dir];
+			if (k >= 0 && k <= 7 && l >= 0 && l <= 7)
+				king_attacks[sq] |= BB_BIT(BB_SQUARE(k, l));
+			while (k >= 0 && k <= 7 && l >= 0 && l <= 7) {
+				rays[dir][sq] |= BB_BIT(BB_SQUARE(k, l));
+				k += row_step[dir];
+				l += col_step[dir];
+			}
+		}
+		if (col > 0) {
+			if (row > 0)
+				pawn_attacks[BB_SIDE(WHITE)][sq] |= BB_BIT(sq - 9);
+			if (row < 7)
+				pawn_attacks[BB_SIDE(BLACK)][sq] |= BB_BIT(sq + 7);
+		}
+		if (col < 7) {
+			if (row > 0)
+				pawn_attacks[BB_SIDE(WHITE)][sq] |= BB_BIT(sq - 7);
+			if (row < 7)
+				pawn_attacks[BB_SIDE(BLACK)][sq] |= BB_BIT(sq + 9);
+		}
+	}
+	for (int sq = 0; sq < 64; sq++) {
+		for (int dir = 0; dir < DIR_COUNT; dir++) {
+			Bitboard ray = rays[dir][sq];
+			while (ray) {
+				int to = _bbPopLsb(&ray);
+				between[sq][to] = rays[dir][sq] & rays[opposite[dir]][to];
+				line[sq][to] = rays[dir][sq] | rays[opposite[dir]][sq] | BB_BIT(sq);
+			}
+		}
+	}
+}
+
+Bitboard _bbRayAttacks(const int dir, const int sq, const Bitboard occ)
+{
+	Bitboard attacks = rays[dir][sq], blockers = attacks & occ;
+
+	if (blockers) {
+		int first = (dir < DIR_N)?__builtin_ctzll(blockers):(63 - __builtin_clzll(blockers));
+		attacks ^= rays[dir][first];
+	}
+	return attacks;
+}
+
+Bitboard _bbRookAttacks(const int sq, const Bitboard occ)
+{
+	return _bbRayAttacks(DIR_N, sq, occ) | _bbRayAttacks(DIR_S, sq, occ)
+		| _bbRayAttacks(DIR_E, sq, occ) | _bbRayAttacks(DIR_W, sq, occ);
+}
+
+Bitboard _bbBishopAttacks(const int sq, const Bitboard occ)
+{
+	return _bbRayAttacks(DIR_NE, sq, occ) | _bbRayAttacks(DIR_NW, sq, occ)
+		| _bbRayAttacks(DIR_SE, sq, occ) | _bbRayAttacks(DIR_SW, sq, occ);
+}
+
+void _loadPosition(Position *pos, ch_template chb[][8])
+{
+	memset(pos, 0, sizeof(Position));
+	for (int i = 0; i < 8; i++) {
+		for (int j = 0; j < 8; j++) {
+			int piece;
+			switch (chb[i][j].current) {
+				case PAWN:
+					piece = BB_PAWN;
+					break;
+				case KING:
+					piece = BB_KING;
+					break;
+				case QUEEN:
+					piece = BB_QUEEN;
+					break;
+				case ROOK:
+					piece = BB_ROOK;
+					break;
+				case KNIGHT:
+					piece = BB_KNIGHT;
+					break;
+				case BISHOP:
+					piece = BB_BISHOP;
+					break;
+				default:
+					continue;
+			}
+			if (chb[i][j].c != BLACK && chb[i][j].c != WHITE)
+				continue;
+			pos->piece[BB_SIDE(chb[i][j].c)][piece] |= BB_BIT(BB_SQUARE(i, j));
+			pos->side[BB_SIDE(chb[i][j].c)] |= BB_BIT(BB_SQUARE(i, j));
+		}
+	}
+	pos->occupied = pos->side[0] | pos->side[1];
+}
+
+int _bbPieceOn(const Position *pos, const int sq, const int side)
+{
+	for (int piece = 0; piece < BB_PIECES; piece++) {
+		if (pos->piece[side][piece] & BB_BIT(sq))
+			return piece;
+	}
+	return BB_PIECES;
+}
+
+void _bbMakeMove(Position *pos, const int from, const int to, PositionUndo *undo)
+{
+	int side = (pos->side[0] & BB_BIT(from))?0:1;
+	int piece = _bbPieceOn(pos, from, side);
+	int captured = _bbPieceOn(pos, to, !side);
+
+	undo->from = from;
+	undo->to = to;
+	undo->piece = piece;
+	undo->captured = captured;
+	undo->rook = false;
+	if (piece == BB_PIECES)
+		return;
+	if (captured != BB_PIECES) {
+		pos->piece[!side][captured] ^= BB_BIT(to);
+		pos->side[!side] ^= BB_BIT(to);
+	}
+	pos->piece[side][piece] ^= BB_BIT(from) | BB_BIT(to);
+	pos->side[side] ^= BB_BIT(from) | BB_BIT(to);
+
+	if (piece == BB_KING && BB_COL(from) == 4 && (BB_COL(to) == 2 || BB_COL(to) == 6)) {
+		int row = (side == BB_SIDE(BLACK))?0:7;
+		int rook_from = BB_SQUARE(row, (BB_COL(to) == 2)?0:7);
+		int rook_to = BB_SQUARE(row, (BB_COL(to) == 2)?3:5);
+		if (pos->piece[side][BB_ROOK] & BB_BIT(rook_from)) {
+			pos->piece[side][BB_ROOK] ^= BB_BIT(rook_from) | BB_BIT(rook_to);
+			pos->side[side] ^= BB_BIT(rook_from) | BB_BIT(rook_to);
+			undo->rook = true;
+		}
+	}
+	pos->occupied = pos->side[0] | pos->side[1];
+}
+
+void _bbUnmakeMove(Position *pos, const PositionUndo *undo)
+{
+	int from = undo->from, to = undo->to;
+	int side = (pos->side[0] & BB_BIT(to))?0:1;
+
+	if (undo->piece == BB_PIECES)
+		return;
+	pos->piece[side][undo->piece] ^= BB_BIT(from) | BB_BIT(to);
+	pos->side[side] ^= BB_BIT(from) | BB_BIT(to);
+	if (undo->captured != BB_PIECES) {
+		pos->piece[!side][undo->captured] ^= BB_BIT(to);
+		pos->side[!side] ^= BB_BIT(to);
+	}
+	if (undo->rook) {
+		int row = BB_ROW(to);
+		Bitboard rook = BB_BIT(BB_SQUARE(row, (BB_COL(to) == 2)?0:7))
+			| BB_BIT(BB_SQUARE(row, (BB_COL(to) == 2)?3:5));
+		pos->piece[side][BB_ROOK] ^= rook;
+		pos->side[side] ^= rook;
+	}
+	pos->occupied = pos->side[0] | pos->side[1];
+}
+
+Bitboard _bbPieceMoves(const Position *pos, const int piece, const int sq, const int side)
+{
+	Bitboard targets = 0, empty = ~pos->occupied;
+
+	switch (piece) {
+		case BB_PAWN:
+			if (side == BB_SIDE(BLACK)) {
+				if (BB_ROW(sq) == 7)
+					break;
+				targets = BB_BIT(sq + 8) & empty;
+				if (BB_ROW(sq) == 1 && targets)
+					targets |= BB_BIT(sq + 16) & empty;
+			} else {
+				if (BB_ROW(sq) == 0)
+					break;
+				targets = BB_BIT(sq - 8) & empty;
+				if (BB_ROW(sq) == 6 && targets)
+					targets |= BB_BIT(sq - 16) & empty;
+			}
+			targets |= pawn_attacks[side][sq] & pos->side[!side];
+			return targets;
+		case BB_KING:
+			targets = king_attacks[sq];
+			break;
+		case BB_QUEEN:
+			targets = _bbRookAttacks(sq, pos->occupied) | _bbBishopAttacks(sq, pos->occupied);
+			break;
+		case BB_ROOK:
+			targets = _bbRookAttacks(sq, pos->occupied);
+			break;
+		case BB_KNIGHT:
+			targets = knight_attacks[sq];
+			break;
+		case BB_BISHOP:
+			targets = _bbBishopAttacks(sq, pos->occupied);
+			break;
+	}
+	return targets & ~pos->side[side];
+}
+
+bool _bbIsAttacked(const Position *pos, const int sq, const int side)
+{
+	return _bbAttackersTo(pos, sq, side, pos->occupied) != 0;
+}
+
+Bitboard _bbAttackersTo(const Position *pos, const int sq, const int side, const Bitboard occ)
+{
+	const Bitboard *p = pos->piece[side];
+
+	return (pawn_attacks[!side][sq] & p[BB_PAWN]) | (knight_attacks[sq] & p[BB_KNIGHT])
+		| (king_attacks[sq] & p[BB_KING]) | (_bbRookAttacks(sq, occ) & (p[BB_ROOK] | p[BB_QUEEN]))
+		| (_bbBishopAttacks(sq, occ) & (p[BB_BISHOP] | p[BB_QUEEN]));
+}
+
+void _bbLegalInfo(const Position *pos, const int side, LegalInfo *info)
+{
+	const Bitboard *them = pos->piece[!side];
+	Bitboard snipers;
+
+	info->pinned = 0;
+	info->checkers = 0;
+	info->evasions = 0;
+	if (!pos->piece[side][BB_KING]) {
+		info->king = -1;
+		return;
+	}
+	info->king = __builtin_ctzll(pos->piece[side][BB_KING]);
+	info->checkers = _bbAttackersTo(pos, info->king, !side, pos->occupied);
+	if (!info->checkers)
+		info->evasions = ~0ULL;
+	else if (!(info->checkers & (info->checkers - 1)))
+		info->evasions = info->checkers | between[info->king][__builtin_ctzll(info->checkers)];
+
+	/*sliders that would attack the King if only the pieces of 'side' were removed*/
+	snipers = (_bbRookAttacks(info->king, pos->side[!side]) & (them[BB_ROOK] | them[BB_QUEEN]))
+		| (_bbBishopAttacks(info->king, pos->side[!side]) & (them[BB_BISHOP] | them[BB_QUEEN]));
+	while (snipers) {
+		Bitboard blockers = between[info->king][_bbPopLsb(&snipers)] & pos->occupied;
+		if (blockers && !(blockers & (blockers - 1)))
+			info->pinned |= blockers & pos->side[side];
+	}
+}
+
+Bitboard _bbLegalMoves(const Position *pos, const LegalInfo *info, const int piece, const int sq, const int side)
+{
+	Bitboard targets = _bbPieceMoves(pos, piece, sq, side), legal = 0;
+
+	if (info->king < 0)
+		return 0;
+	if (piece == BB_KING) {
+		Bitboard occ = pos->occupied ^ BB_BIT(sq);
+		while (targets) {
+			int to = _bbPopLsb(&targets);
+			if (!_bbAttackersTo(pos, to, !side, occ))
+				legal |= BB_BIT(to);
+		}
+		return legal;
+	}
+	targets &= info->evasions;
+	if (info->pinned & BB_BIT(sq))
+		targets &= line[info->king][sq];
+	return targets;
+}
+
+void _bbSquareName(const int sq, char *name)
+{
+	name[0] = 'A' + BB_COL(sq);
+	name[1] = '8' - BB_ROW(sq);
+}
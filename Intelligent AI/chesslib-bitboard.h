@@ -0,0 +1,103 @@
+/*********************************************************************
+ *                         chesslib-bitboard.h                       *
+ *          bitboard position representation used by chesslib        *
+ *                                                                   *
+ *               (C)2015 <georgekoskerid@outlook.com>                *
+ *                                                                   *
+ *********************************************************************/
+
+#ifndef CHESSLIB_BITBOARD_H
+#define CHESSLIB_BITBOARD_H
+
+#include "stdint.h"
+#include "chesslib.h"
+
+/*squares are numbered like the ch_template array: 0 is A8, 7 is H8, 56 is A1 and 63 is H1*/
+#define BB_SQUARE(row, col) ((row)*8 + (col))
+#define BB_ROW(sq) ((sq) >> 3)
+#define BB_COL(sq) ((sq) & 7)
+#define BB_BIT(sq) (1ULL << (sq))
+
+/*color index used by the bitboard arrays; white is 0 and black is 1*/
+#define BB_SIDE(color) ((color) == BLACK)
+
+/*piece indexes; they follow the order of the b_moves/w_moves lists*/
+enum {
+	BB_PAWN,
+	BB_KING,
+	BB_QUEEN,
+	BB_ROOK,
+	BB_KNIGHT,
+	BB_BISHOP,
+	BB_PIECES
+};
+
+typedef uint64_t Bitboard;
+
+/*position made of one bitboard per piece type and color*/
+typedef struct Position {
+	Bitboard piece[2][BB_PIECES];
+	Bitboard side[2];	/*all the pieces of one color*/
+	Bitboard occupied;
+} Position;
+
+/*what _bbUnmakeMove needs to take a move back*/
+typedef struct PositionUndo {
+	unsigned char from;
+	unsigned char to;
+	unsigned char piece;
+	unsigned char captured;	/*BB_PIECES if nothing was captured*/
+	bool rook;	/*the move was a castling and the rook moved too*/
+} PositionUndo;
+
+/*what the legal move generator needs to know about the King of one side*/
+typedef struct LegalInfo {
+	int king;	/*square of the King, -1 if it's missing*/
+	Bitboard checkers;	/*pieces giving check*/
+	Bitboard pinned;	/*own pieces that can only move along the line to their King*/
+	Bitboard evasions;	/*squares that capture or block a single checker; all squares when not in check*/
+} LegalInfo;
+
+
+/*fills a Position with the pieces found on a ch_template board*/
+void _loadPosition(Position *pos, ch_template chb[][8]);
+
+/*moves whatever stands on 'from' to 'to', capturing anything that was on 'to';
+ *castling king moves also move the rook, exactly like _makeMove does*/
+void _bbMakeMove(Position *pos, const int from, const int to, PositionUndo *undo);
+
+/*takes back a move played with _bbMakeMove*/
+void _bbUnmakeMove(Position *pos, const PositionUndo *undo);
+
+/*squares a piece of the given type and color standing on sq can move to;
+ *castling is not included, it depends on state the position does not hold*/
+Bitboard _bbPieceMoves(const Position *pos, const int piece, const int sq, const int side);
+
+/*true if sq is attacked by any piece of 'side'*/
+bool _bbIsAttacked(const Position *pos, const int sq, const int side);
+
+/*pieces of 'side' attacking sq when the board occupancy is occ*/
+Bitboard _bbAttackersTo(const Position *pos, const int sq, const int side, const Bitboard occ);
+
+/*finds the checkers, the pinned pieces and the check evasion squares of 'side'*/
+void _bbLegalInfo(const Position *pos, const int side, LegalInfo *info);
+
+/*like _bbPieceMoves, but only the moves that don't leave the King of 'side' in danger;
+ *a side without a King has no legal moves*/
+Bitboard _bbLegalMoves(const Position *pos, const LegalInfo *info, const int piece, const int sq, const int side);
+
+Bitboard _bbRookAttacks(const int sq, const Bitboard occ);
+Bitboard _bbBishopAttacks(const int sq, const Bitboard occ);
+
+/*writes the two character name of sq, e.g. "E2", to name*/
+void _bbSquareName(const int sq, char *name);
+
+/*index of the least significant bit of bb, which is then cleared*/
+static inline int _bbPopLsb(Bitboard *bb)
+{
+	int sq = __builtin_ctzll(*bb);
+	*bb &= *bb - 1;
+	return sq;
+}
+
+#endif
@@ -9,225 +9,477 @@
  *                                                                   *
  *********************************************************************/
 
+#include "pthread.h"
 #include "chesslib.h"
+#include "chesslib-bitboard.h"
+#include "chesslib-game.h"
 
-#define MOVE_COUNT 50
+#define AI_MATE 100000	/*score of a side that is checkmated at the root*/
+#define AI_TREE_LEVELS 32	/*most plies the dumped move tree can have*/
 
-#define NULL_50(x)                           \
-{                                            \
-    for (int g = 0; g < MOVE_COUNT; g++) {   \
-        x[g] = NULL;                         \
-    }                                        \
-}
+static const int piece_value[BB_PIECES] = AI_PIECE_VALUES;
 
-/*struct for each node/leaf of the AI move tree; the number of children is statically allocated*/
+/*node of the AI move tree; the tree is stored one level after the other, in breadth order,
+ *and the children of a node are contiguous in the next level, so an index and a count find them*/
 typedef struct MoveTreeNode {
-	char start[3], end[3];
-	int color, score;
-	unsigned short depth;
-	struct MoveTreeNode *child[MOVE_COUNT];
-	struct MoveTreeNode *parent;
+	uint32_t first_child;	/*index of the first child in the next level*/
+	uint16_t child_count;
+	ChessMove move;	/*move that leads to this node*/
+	int16_t score;	/*_Evaluate() for the player that made the move*/
 } MoveTreeNode;
 
-typedef struct HeapListNode{
-	void *alloc_mem;
-	struct HeapListNode *nxt;
-} HeapListNode;
-
-/*********
- *globals*
- *********/
-
-static unsigned short max_depth;
-static int CPU_PLAYER;
-static HeapListNode *AIHeap;
-unsigned short __attribute__((unused)) total_black_pieces;
-unsigned short __attribute__((unused)) total_white_pieces;
-
+typedef struct MoveTree {
+	MoveTreeNode *level[AI_TREE_LEVELS + 1];	/*level[0] only holds the root*/
+	uint32_t count[AI_TREE_LEVELS + 1];	/*nodes on each level*/
+	unsigned short depth;	/*levels below the root that were built*/
+} MoveTree;
+
+/*the root moves of one getAImove() call, handed out one at a time to the worker threads*/
+typedef struct RootSearch {
+	const Position *pos;	/*position before the root moves; every worker plays on its own copy*/
+	const ChessMove *moves;
+	unsigned short count;
+	unsigned short depth;
+	int side;
+	unsigned next;	/*index of the next root move to hand out*/
+	int alpha;	/*best score found so far by any worker*/
+	int score[MAX_MOVES];
+} RootSearch;
+
+/*a move of _alphaBeta and how early it is tried: captures that don't lose material by _bbSee first,
+ *then the quiet moves, then the captures that lose material*/
+typedef struct OrderedMove {
+	unsigned char from;
+	unsigned char to;
+	int order;
+} OrderedMove;
 
 /******************************************************************
  *prototypes for functions used in chlib-computer.c and chesslib.c*
  ******************************************************************/
 
-void _copyBoard(ch_template to[][8], ch_template from[][8]);
-bool _makeMove(ch_template chb[][8], char *st_move, char *en_move, const int color, const bool ListCheck);
+void _moveToStrings(const ChessMove move, char *st, char *en);
+int _pieceIndex(const char piece);
+bool _makeMove(ChessGame *game, ch_template chb[][8], char *st_move, char *en_move, const int color, const bool ListCheck, MoveUndo *undo);
+void _unmakeMove(ChessGame *game, ch_template chb[][8], const MoveUndo *undo);
+void _arenaFree(AIArena *arena);
 
 
 /***************************************************
  *prototypes for functions used in chlib-computer.c*
  ***************************************************/
 
-int _Evaluate(ch_template chb[][8], const int color);
-int _evaluateNext(ch_template chb[][8], const int color, char *st, char *en);
-void _deleteAIHeap();
-void _addToAIHeap(void **x);
-void _printAIMoveTree(MoveTreeNode *curr_leaf);
-void _createAIMoveTree(MoveTreeNode **curr_leaf, ch_template chb[][8], const int color, const unsigned short depth_count);
-
-char *getAImove(ch_template chb[][8], const int color, const unsigned short depth)
+int _Evaluate(const ChessGame *game, const int color);
+int _bbEvaluate(const Position *pos, const int side);
+int _alphaBeta(Position *pos, const int side, const unsigned short depth, const unsigned short ply, int alpha, int beta);
+unsigned short _orderedMoves(const Position *pos, const LegalInfo *info, const int side, OrderedMove *moves);
+int _bbSee(const Position *pos, const int from, const int to, const int side);
+void *_rootWorker(void *arg);
+void _dumpAIMoveTree(ChessGame *game, ch_template chb[][8], const int color, const unsigned short depth);
+int _evaluateNext(const ChessGame *game, ch_template chb[][8], const int color, char *st, char *en);
+void *_arenaAlloc(AIArena *arena, size_t size);
+void _arenaReset(AIArena *arena);
+int _levelColor(const ChessGame *game, const unsigned short level);
+unsigned short _childMoves(ChessGame *game, ch_template chb[][8], const MoveTreeNode *node, const unsigned short level, ChessMove *moves);
+void _expandLevel(ChessGame *game, MoveTree *tree, ch_template chb[][8], const uint32_t index, const unsigned short level,
+				  const unsigned short target, const bool fill, uint32_t *next);
+void _printAIMoveTree(const ChessGame *game, const MoveTree *tree, const unsigned short level, const uint32_t index);
+bool _createAIMoveTree(ChessGame *game, MoveTree *tree, ch_template chb[][8], const unsigned short depth);
+
+char *getAImove(ChessGame *game, ch_template chb[][8], const int color, const unsigned short depth)
 {
 	if (!depth || (color != BLACK && color != WHITE))
 		return NULL;
 
-	char *retvalue = NULL;
-	AIHeap = NULL;
-	CPU_PLAYER = color;
-	max_depth = depth - 1;
-	MoveTreeNode *top = NULL;
-	_createAIMoveTree(&top, chb, color, 0);
-#if 1
-	_printAIMoveTree(top);
+	ChessMove root[MAX_MOVES];
+	unsigned short root_count = 0;
+	pthread_t worker[AI_MAX_THREADS];
+	unsigned short workers = 0;
+	RootSearch search;
+	Position pos;
+
+	/*the root moves come from getAllMoves(), so castling is searched at the root only*/
+	getAllMoves(game, chb, color);
+	const MoveNode *moves = getMoveList(game, color);
+	for (int piece = 0; piece < 6; piece++)
+		for (unsigned short i = 0; i < moves[piece].count; i++)
+			root[root_count++] = moves[piece].move[i];
+	if (!root_count)
+		return NULL;
+
+	_loadPosition(&pos, chb);
+	search = (RootSearch){&pos, root, root_count, depth, BB_SIDE(color), 0, -AI_MATE - 1, {0}};
+	/*the calling thread is a worker too; if a thread can't be started the others do its share*/
+	while (workers + 1 < game->ai_threads && workers + 1 < root_count
+		   && !pthread_create(&worker[workers], NULL, _rootWorker, &search))
+		workers++;
+	_rootWorker(&search);
+	for (unsigned short i = 0; i < workers; i++)
+		pthread_join(worker[i], NULL);
+
+	/*the first move with the best score, whatever order the workers finished in*/
+	ChessMove best = root[0];
+	int best_score = search.score[0];
+	for (unsigned short i = 1; i < root_count; i++) {
+		if (search.score[i] > best_score) {
+			best_score = search.score[i];
+			best = root[i];
+		}
+	}
+
+#ifdef CHESSLIB_DUMP_TREE
+	_dumpAIMoveTree(game, chb, color, depth);
 #endif
+	char st[3], en[3];
+	_moveToStrings(best, st, en);
+	snprintf(game->ai_move, sizeof game->ai_move, "%s%s", st, en);
+	return game->ai_move;
+}
 
-	_deleteAIHeap();
-	max_depth = 0;
-	return retvalue;
+/*negamax alpha-beta: score of 'side' to move, searched 'depth' plies deep; only the
+ *current path is kept in memory, as one Position that is made and unmade in place*/
+int _alphaBeta(Position *pos, const int side, const unsigned short depth, const unsigned short ply, int alpha, int beta)
+{
+	LegalInfo info;
+	OrderedMove moves[MAX_MOVES];
+
+	if (!depth)
+		return _bbEvaluate(pos, side);
+
+	_bbLegalInfo(pos, side, &info);
+	unsigned short count = _orderedMoves(pos, &info, side, moves);
+	/*no legal moves: checkmate, the later the better, or stalemate*/
+	if (!count)
+		return (info.checkers || info.king < 0)?-AI_MATE + ply:0;
+	for (unsigned short i = 0; i < count; i++) {
+		/*the best move left goes next; a cutoff usually comes early, so the rest is never sorted*/
+		for (unsigned short j = i + 1; j < count; j++) {
+			if (moves[j].order > moves[i].order) {
+				OrderedMove tmp = moves[i];
+				moves[i] = moves[j];
+				moves[j] = tmp;
+			}
+		}
+		PositionUndo undo;
+		_bbMakeMove(pos, moves[i].from, moves[i].to, &undo);
+		int score = -_alphaBeta(pos, !side, depth - 1, ply + 1, -beta, -alpha);
+		_bbUnmakeMove(pos, &undo);
+		if (score >= beta)
+			return score;
+		if (score > alpha)
+			alpha = score;
+	}
+	return alpha;
 }
 
-void _addToAIHeap(void **x)
+/*the legal moves of 'side' with their order for _alphaBeta; returns how many there are*/
+unsigned short _orderedMoves(const Position *pos, const LegalInfo *info, const int side, OrderedMove *moves)
 {
-	HeapListNode *new = malloc(sizeof(HeapListNode));
-	new->alloc_mem = *x;
-	new->nxt = AIHeap;
-	AIHeap = new;
+	unsigned short count = 0;
+
+	for (int piece = 0; piece < BB_PIECES; piece++) {
+		Bitboard pieces = pos->piece[side][piece];
+		while (pieces) {
+			int from = _bbPopLsb(&pieces);
+			Bitboard targets = _bbLegalMoves(pos, info, piece, from, side);
+			while (targets) {
+				int to = _bbPopLsb(&targets);
+				int order = 0;
+				if (pos->side[!side] & BB_BIT(to)) {
+					int see = _bbSee(pos, from, to, side);
+					order = (see >= 0)?AI_MATE + see:see;
+				}
+				moves[count++] = (OrderedMove){from, to, order};
+			}
+		}
+	}
+	return count;
 }
 
-void _deleteAIHeap()
+/*static exchange evaluation: material 'side' wins by capturing on 'to' with the piece on 'from',
+ *when both sides then take turns recapturing there with their least valuable piece, and each
+ *stops as soon as going on would lose; sliders behind the pieces that captured join in too*/
+int _bbSee(const Position *pos, const int from, const int to, const int side)
 {
-	for (;;) {
-		if (!AIHeap)
+	/*least valuable first; the King is last whatever its weight in piece_value*/
+	static const int cheapest[BB_PIECES] = {BB_PAWN, BB_KNIGHT, BB_BISHOP, BB_ROOK, BB_QUEEN, BB_KING};
+	Bitboard occ = pos->occupied ^ BB_BIT(from), attackers[2];
+	int gain[32], d = 0, s = !side, on_square = 0;
+
+	gain[0] = 0;
+	for (int piece = 0; piece < BB_PIECES; piece++) {
+		if (pos->piece[!side][piece] & BB_BIT(to))
+			gain[0] = piece_value[piece];
+		if (pos->piece[side][piece] & BB_BIT(from))
+			on_square = piece_value[piece];
+	}
+	attackers[0] = _bbAttackersTo(pos, to, 0, occ) & occ;
+	attackers[1] = _bbAttackersTo(pos, to, 1, occ) & occ;
+	while (d < 31 && attackers[s]) {
+		int piece = 0;
+		while (!(attackers[s] & pos->piece[s][cheapest[piece]]))
+			piece++;
+		piece = cheapest[piece];
+		/*the King may only take when nothing takes it back*/
+		if (piece == BB_KING && attackers[!s])
 			break;
-		HeapListNode *curr = AIHeap;
-		curr = curr->nxt;
-		free(AIHeap->alloc_mem);
-		free(AIHeap);
-		AIHeap = curr;
+		d++;
+		gain[d] = on_square - gain[d - 1];
+		occ ^= BB_BIT(__builtin_ctzll(attackers[s] & pos->piece[s][piece]));
+		attackers[0] = _bbAttackersTo(pos, to, 0, occ) & occ;
+		attackers[1] = _bbAttackersTo(pos, to, 1, occ) & occ;
+		on_square = piece_value[piece];
+		s = !s;
+	}
+	for (; d > 0; d--)
+		if (-gain[d] < gain[d - 1])
+			gain[d - 1] = -gain[d];
+	return gain[0];
+}
+
+/*searches root moves until none are left; each one is searched with a window just below the best
+ *score so far, so a move that ties with it still gets its exact score and the result doesn't depend
+ *on which worker got there first*/
+void *_rootWorker(void *arg)
+{
+	RootSearch *search = arg;
+	Position pos = *search->pos;
+	unsigned i;
+
+	while ((i = __atomic_fetch_add(&search->next, 1, __ATOMIC_RELAXED)) < search->count) {
+		PositionUndo undo;
+		int alpha = __atomic_load_n(&search->alpha, __ATOMIC_RELAXED);
+
+		_bbMakeMove(&pos, MOVE_FROM(search->moves[i]), MOVE_TO(search->moves[i]), &undo);
+		int score = -_alphaBeta(&pos, !search->side, search->depth - 1, 1, -AI_MATE - 1, -(alpha - 1));
+		_bbUnmakeMove(&pos, &undo);
+		search->score[i] = score;
+		while (score > alpha && !__atomic_compare_exchange_n(&search->alpha, &alpha, score, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+			;
+	}
+	return NULL;
+}
+
+/*material of 'side' minus the material of the other side, with the weights of _Evaluate*/
+int _bbEvaluate(const Position *pos, const int side)
+{
+	int score = 0;
+
+	for (int piece = 0; piece < BB_PIECES; piece++)
+		score += piece_value[piece]*(__builtin_popcountll(pos->piece[side][piece]) - __builtin_popcountll(pos->piece[!side][piece]));
+	return score;
+}
+
+/*builds and prints the whole move tree the way getAImove() used to; debugging aid only,
+ *its memory grows with the number of positions in the tree*/
+void _dumpAIMoveTree(ChessGame *game, ch_template chb[][8], const int color, const unsigned short depth)
+{
+	MoveTree tree;
+
+	game->CPU_PLAYER = color;
+	if (_createAIMoveTree(game, &tree, chb, depth))
+		_printAIMoveTree(game, &tree, 0, 0);
+	_arenaReset(&game->arena);
+}
+
+/*hands out size bytes from the current chunk, moving on to the next chunk (or a new one, while the
+ *arena is under its limit) when it's full; NULL once the limit is reached*/
+void *_arenaAlloc(AIArena *arena, size_t size)
+{
+	size = (size + 15) & ~(size_t)15;
+	while (!arena->current || arena->current->used + size > arena->current->size) {
+		if (arena->current && arena->current->next) {
+			arena->current = arena->current->next;
+			arena->current->used = 0;
+			continue;
+		}
+		size_t chunk_size = (size > AI_ARENA_CHUNK)?size:AI_ARENA_CHUNK;
+		if (arena->total + chunk_size > arena->limit)
+			return NULL;
+		ArenaChunk *chunk = malloc(sizeof(ArenaChunk) + chunk_size);
+		if (!chunk)
+			return NULL;
+		chunk->next = NULL;
+		chunk->size = chunk_size;
+		chunk->used = 0;
+		arena->total += chunk_size;
+		if (arena->current)
+			arena->current->next = chunk;
+		else
+			arena->first = chunk;
+		arena->current = chunk;
 	}
+	void *mem = arena->current->data + arena->current->used;
+	arena->current->used += size;
+	return mem;
 }
 
-void _printAIMoveTree(MoveTreeNode *curr_leaf)
+/*gives back everything allocated so far; the chunks stay around for the next tree*/
+void _arenaReset(AIArena *arena)
 {
-	if (!curr_leaf)
+	arena->current = arena->first;
+	if (arena->current)
+		arena->current->used = 0;
+}
+
+void _arenaFree(AIArena *arena)
+{
+	while (arena->first) {
+		ArenaChunk *next = arena->first->next;
+		free(arena->first);
+		arena->first = next;
+	}
+	arena->current = NULL;
+	arena->total = 0;
+}
+
+void _printAIMoveTree(const ChessGame *game, const MoveTree *tree, const unsigned short level, const uint32_t index)
+{
+	const MoveTreeNode *node = &tree->level[level][index];
+	char st[3], en[3], child_st[3], child_en[3];
+
+	if (level >= tree->depth)
 		return;
-	for (int i = 0; i < MOVE_COUNT; i++) {
-		if ((curr_leaf->depth > max_depth) || (!curr_leaf->child[i]))
-			return;
-		for (int j = 0; j < (curr_leaf->depth); j++) putchar('\t');
-		if (curr_leaf->child[i]->depth == 1) {
-			printf("At depth %d, initial moves for %s are: %s->%s", curr_leaf->child[i]->depth, (curr_leaf->child[i]->color == BLACK)?"Black":"White",
-				   curr_leaf->child[i]->start, curr_leaf->child[i]->end);
-#ifdef DEBUG
-			printf(", current score is %d\n", curr_leaf->child[i]->score);
-#else
-			putchar('\n');
-#endif
+	_moveToStrings(node->move, st, en);
+	for (uint16_t i = 0; i < node->child_count; i++) {
+		const MoveTreeNode *child = &tree->level[level + 1][node->first_child + i];
+		int color = _levelColor(game, level + 1);
+
+		_moveToStrings(child->move, child_st, child_en);
+		for (int j = 0; j < level; j++) putchar('\t');
+		if (!level) {
+			printf("At depth 1, initial moves for %s are: %s->%s", (color == BLACK)?"Black":"White", child_st, child_en);
 		} else {
-			printf("At depth %d, for %s move %s->%s: %s moves %s->%s", curr_leaf->child[i]->depth, (curr_leaf->child[i]->color == BLACK)?"Black's":"White's",
-				   curr_leaf->start, curr_leaf->end, (curr_leaf->child[i]->color == BLACK)?"White":"Black", curr_leaf->child[i]->start, curr_leaf->child[i]->end);
+			printf("At depth %d, for %s move %s->%s: %s moves %s->%s", level + 1, (color == BLACK)?"White's":"Black's",
+				   st, en, (color == BLACK)?"Black":"White", child_st, child_en);
+		}
 #ifdef DEBUG
-			printf(", current score is %d\n", curr_leaf->child[i]->score);
+		printf(", current score is %d\n", child->score);
 #else
-			putchar('\n');
+		putchar('\n');
 #endif
-		}
-		_printAIMoveTree(curr_leaf->child[i]);
+		_printAIMoveTree(game, tree, level + 1, node->first_child + i);
 	}
 }
 
-void _createAIMoveTree(MoveTreeNode **curr_leaf, ch_template chb[][8], const int color, const unsigned short depth_count)
+/*player that made the moves on a level of the tree; level 1 holds the moves of the computer*/
+int _levelColor(const ChessGame *game, const unsigned short level)
 {
-	ch_template next_chb[8][8];
-	int __attribute__((unused)) temp_eval = 0;
-	int move_list_count = 0;
-
-	MoveNode *temp_moves[6];
-	getAllMoves(chb, color);
-	for (int i = 0; i < 6; i++)
-		temp_moves[i] = (color == BLACK)?b_moves[i]:w_moves[i];
+	if (level & 1)
+		return game->CPU_PLAYER;
+	return (game->CPU_PLAYER == BLACK)?WHITE:BLACK;
+}
 
-	if (!depth_count) {
-		(*curr_leaf) = malloc(sizeof(MoveTreeNode));
-		(*curr_leaf)->depth = 0;
-		(*curr_leaf)->start[0] = 'T';
-		(*curr_leaf)->start[1] = '\0';
-		(*curr_leaf)->parent = NULL;
-		_addToAIHeap((void*)(&(*curr_leaf)));
-	}
-	for (int i = 0; i < MOVE_COUNT; i++) {
-		while (!temp_moves[move_list_count]) {
-			move_list_count++;
-		}
-		if (move_list_count > 5) {
-			(*curr_leaf)->child[i] = NULL;
-		} else {
-			if (color != CPU_PLAYER) {
-				if (_evaluateNext(chb, (color == BLACK)?WHITE:BLACK, temp_moves[move_list_count]->start, temp_moves[move_list_count]->end) > (*curr_leaf)->score) {
-					(*curr_leaf)->child[i] = NULL;
-					temp_moves[move_list_count] = temp_moves[move_list_count]->nxt;
+/*the moves that become the children of a node on 'level', with chb in the position of that node;
+ *replies of the opponent that would leave the computer ahead of the node's score are left out*/
+unsigned short _childMoves(ChessGame *game, ch_template chb[][8], const MoveTreeNode *node, const unsigned short level, ChessMove *moves)
+{
+	int color = _levelColor(game, level + 1);
+	unsigned short count = 0;
+	char st[3], en[3];
+
+	getAllMoves(game, chb, color);
+	const MoveNode *list = getMoveList(game, color);
+	for (int piece = 0; piece < 6; piece++) {
+		for (unsigned short i = 0; i < list[piece].count; i++) {
+			if (color != game->CPU_PLAYER) {
+				_moveToStrings(list[piece].move[i], st, en);
+				if (_evaluateNext(game, chb, game->CPU_PLAYER, st, en) > node->score)
 					continue;
-				}
 			}
-			(*curr_leaf)->child[i] = malloc(sizeof(MoveTreeNode));
-			(*curr_leaf)->child[i]->parent = (*curr_leaf);
-			(*curr_leaf)->child[i]->color = color;
-			(*curr_leaf)->child[i]->depth = depth_count + 1;
-			(*curr_leaf)->child[i]->start[2] = (*curr_leaf)->child[i]->end[2] = '\0';
-			(*curr_leaf)->child[i]->start[0] = temp_moves[move_list_count]->start[0];
-			(*curr_leaf)->child[i]->start[1] = temp_moves[move_list_count]->start[1];
-			(*curr_leaf)->child[i]->end[0] = temp_moves[move_list_count]->end[0];
-			(*curr_leaf)->child[i]->end[1] = temp_moves[move_list_count]->end[1];
-			_addToAIHeap((void*)(&(*curr_leaf)->child[i]));
-			temp_moves[move_list_count] = temp_moves[move_list_count]->nxt;
+			moves[count++] = list[piece].move[i];
 		}
 	}
+	return count;
+}
 
-	for (int i = 0; i < MOVE_COUNT; i++) {
-		if (!(*curr_leaf)->child[i]) {
-			return;
-		}
-		_copyBoard(next_chb, chb);
-		_makeMove(next_chb, (*curr_leaf)->child[i]->start, (*curr_leaf)->child[i]->end, (*curr_leaf)->child[i]->color, false);
-		(*curr_leaf)->child[i]->score = _Evaluate(next_chb, color);
-
-		if (!depth_count) {
-			_createAIMoveTree(&((*curr_leaf)->child[i]), next_chb, color, depth_count+1);
-		} else if (depth_count <= max_depth) {
-			_createAIMoveTree(&((*curr_leaf)->child[i]), next_chb, (color == BLACK)?WHITE:BLACK, depth_count+1);
+/*walks the tree down to the nodes on 'target', playing the moves on chb on the way, and gives them
+ *children: first (fill == false) it only counts them and hands out their places in the next level
+ *from *next, then (fill == true) it writes them into those places*/
+void _expandLevel(ChessGame *game, MoveTree *tree, ch_template chb[][8], const uint32_t index, const unsigned short level,
+				  const unsigned short target, const bool fill, uint32_t *next)
+{
+	MoveTreeNode *node = &tree->level[level][index];
+	ChessMove moves[MAX_MOVES];
+	MoveUndo undo;
+	char st[3], en[3];
+
+	if (level < target) {
+		for (uint16_t i = 0; i < node->child_count; i++) {
+			_moveToStrings(tree->level[level + 1][node->first_child + i].move, st, en);
+			_makeMove(game, chb, st, en, _levelColor(game, level + 1), false, &undo);
+			_expandLevel(game, tree, chb, node->first_child + i, level + 1, target, fill, next);
+			_unmakeMove(game, chb, &undo);
 		}
+		return;
+	}
+
+	unsigned short count = _childMoves(game, chb, node, level, moves);
+	if (!fill) {
+		node->first_child = *next;
+		node->child_count = count;
+		*next += count;
+		return;
+	}
+	for (unsigned short i = 0; i < count; i++) {
+		MoveTreeNode *child = &tree->level[level + 1][node->first_child + i];
+		child->move = moves[i];
+		child->first_child = 0;
+		child->child_count = 0;
+		_moveToStrings(moves[i], st, en);
+		_makeMove(game, chb, st, en, _levelColor(game, level + 1), false, &undo);
+		child->score = _Evaluate(game, _levelColor(game, level + 1));
+		_unmakeMove(game, chb, &undo);
 	}
 }
 
-int _evaluateNext(ch_template chb[][8], const int color, char *st, char *en)
+/*builds the tree one level at a time, each level in a single block of the arena; when the arena
+ *runs out the tree just ends at the last level that fit. False if not even the root fit*/
+bool _createAIMoveTree(ChessGame *game, MoveTree *tree, ch_template chb[][8], const unsigned short depth)
 {
-	ch_template temp_chb[8][8];
+	tree->depth = 0;
+	tree->count[0] = 1;
+	if (!(tree->level[0] = _arenaAlloc(&game->arena, sizeof(MoveTreeNode))))
+		return false;
+	*tree->level[0] = (MoveTreeNode){0, 0, 0, 0};
+
+	for (unsigned short level = 0; level < depth && level < AI_TREE_LEVELS; level++) {
+		uint32_t count = 0;
+		_expandLevel(game, tree, chb, 0, 0, level, false, &count);
+		if (!count || !(tree->level[level + 1] = _arenaAlloc(&game->arena, count*sizeof(MoveTreeNode)))) {
+			for (uint32_t i = 0; i < tree->count[level]; i++)
+				tree->level[level][i].child_count = 0;
+			break;
+		}
+		tree->count[level + 1] = count;
+		_expandLevel(game, tree, chb, 0, 0, level, true, &count);
+		tree->depth = level + 1;
+	}
+	return true;
+}
 
-	_copyBoard(temp_chb, chb);
-	_makeMove(temp_chb, st, en, color, false);
-	return _Evaluate(temp_chb, color);
+/*_Evaluate() for 'color' once the move st-en is played, worked out from what the move captures*/
+int _evaluateNext(const ChessGame *game, ch_template chb[][8], const int color, char *st, char *en)
+{
+	const ch_template *from = &chb['8' - st[1]][toupper(st[0]) - 'A'];
+	const ch_template *to = &chb['8' - en[1]][toupper(en[0]) - 'A'];
+	int side = BB_SIDE(color), material = game->material[side], kings = game->piece_count[side][BB_KING];
+
+	if (from->current != NOPIECE && to->current != NOPIECE && to->c == color) {
+		int idx = _pieceIndex(to->current);
+		material -= piece_value[idx];
+		if (idx == BB_KING)
+			kings--;
+	}
+	return kings?material:-1;
 }
 
-int _Evaluate(ch_template chb[][8], const int color)
+/*material of 'color', or -1 if its King is gone; the counts come from the game, kept by _makeMove*/
+int _Evaluate(const ChessGame *game, const int color)
 {
-	unsigned short b_pawn_count, b_queen_count, b_king_count, b_bishop_count, b_rook_count, b_knight_count;
-	unsigned short w_pawn_count, w_queen_count, w_king_count, w_bishop_count, w_rook_count, w_knight_count;
-	int black_material_balance, white_material_balance;
+	int side = BB_SIDE(color);
 
-	b_pawn_count = b_queen_count = b_king_count = b_bishop_count = b_rook_count = b_knight_count = 0;
-	w_pawn_count = w_queen_count = w_king_count = w_bishop_count = w_rook_count = w_knight_count = 0;
-	for (int row = 0; row < 8; row++) {
-		for (int col = 0; col < 8; col++) {
-			if (chb[row][col].current == PAWN) (chb[row][col].c == BLACK)?(b_pawn_count++):(w_pawn_count++);
-			if (chb[row][col].current == QUEEN) (chb[row][col].c == BLACK)?(b_queen_count++):(w_queen_count++);
-			if (chb[row][col].current == KING) (chb[row][col].c == BLACK)?(b_king_count++):(w_king_count++);
-			if (chb[row][col].current == BISHOP) (chb[row][col].c == BLACK)?(b_bishop_count++):(w_bishop_count++);
-			if (chb[row][col].current == ROOK) (chb[row][col].c == BLACK)?(b_rook_count++):(w_rook_count++);
-			if (chb[row][col].current == KNIGHT) (chb[row][col].c == BLACK)?(b_knight_count++):(w_knight_count++);
-		}
-	}
-	black_material_balance = (b_pawn_count*100) + (b_queen_count*900) + (b_rook_count*500) + (b_bishop_count*325) + (b_knight_count*300);
-	white_material_balance = (w_pawn_count*100) + (w_queen_count*900) + (w_rook_count*500) + (w_bishop_count*325) + (w_knight_count*300);
-	if ((!w_king_count && color == WHITE) || (!b_king_count && color == BLACK)) {
+	if (!game->piece_count[side][BB_KING])
 		return -1;
-	}
-
-	return (color == BLACK)?black_material_balance:white_material_balance;}
+	return game->material[side];
+}
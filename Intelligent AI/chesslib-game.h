@@ -0,0 +1,92 @@
+/*********************************************************************
+ *                           chesslib-game.h                         *
+ *            private definition of the ChessGame structure          *
+ *                                                                   *
+ *               (C)2015 <georgekoskerid@outlook.com>                *
+ *                                                                   *
+ *********************************************************************/
+
+#ifndef CHESSLIB_GAME_H
+#define CHESSLIB_GAME_H
+
+#include "chesslib.h"
+
+#define HISTORY_SIZE 1024	/*moves makeMove() remembers for unmakeMove()*/
+#define AI_ARENA_CHUNK (1 << 20)	/*bytes the AI arena asks malloc() for at a time*/
+#define AI_ARENA_LIMIT (64 << 20)	/*default cap of the AI arena, see setAIMemoryLimit()*/
+#define AI_MAX_THREADS 64	/*most threads getAImove() searches with, see setAIThreads()*/
+#define AI_PIECE_VALUES {100, 0, 900, 500, 300, 325}	/*material of each piece, in _pieceIndex() order*/
+
+
+typedef struct CastlingBool {
+	bool WR_left;	/*white rook at A1*/
+	bool WR_right;	/*white rook at H1*/
+	bool BR_left;	/*black rook at A8*/
+	bool BR_right;	/*black rook at H8*/
+	bool KWhite;	/*white king*/
+	bool KBlack;	/*black king*/
+} CastlingBool;
+
+/*contiguous storage for the moves of one player, grouped by piece; b_moves and w_moves are views over it*/
+typedef struct MoveBuffer {
+	ChessMove move[MAX_MOVES];
+	unsigned short count;
+} MoveBuffer;
+
+/*one block of memory the AI arena hands out; chunks are kept after a reset and reused*/
+typedef struct ArenaChunk {
+	struct ArenaChunk *next;
+	size_t size, used;
+	unsigned char data[] __attribute__((aligned(16)));
+} ArenaChunk;
+
+/*bump allocator for the nodes of the AI move tree; a reset only rewinds it*/
+typedef struct AIArena {
+	ArenaChunk *first, *current;
+	size_t total;	/*bytes held by all the chunks*/
+	size_t limit;	/*most bytes the chunks may hold*/
+} AIArena;
+
+/*everything a single match needs; nothing in chesslib is shared between two ChessGame handles*/
+struct ChessGame {
+	/*the move lists of both players, for each piece; they get a value after every getAllMoves() call*/
+	MoveBuffer black_buffer;
+	MoveBuffer white_buffer;
+	MoveNode b_moves[6];
+	MoveNode w_moves[6];
+
+	/*counters for the total moves each player (Black and White) can do on each round*/
+	unsigned white_move_count, black_move_count;
+
+	KingState WhiteKing;
+	KingState BlackKing;
+
+	CastlingBool check_castling;
+
+	unsigned w_enpassant_round_left;
+	unsigned w_enpassant_round_right;
+	unsigned b_enpassant_round_left;
+	unsigned b_enpassant_round_right;
+	bool enpassant;
+	unsigned char enpassant_file;	/*column of the pawn that can be taken en passant*/
+
+	uint64_t key;	/*Zobrist key of the position, see getZobristKey()*/
+
+	/*pieces of each kind and material of each color, indexed by BB_SIDE() and _pieceIndex();
+	 *_makeMove keeps them up to date like the key*/
+	unsigned char piece_count[2][6];
+	int material[2];
+
+	MoveUndo history[HISTORY_SIZE];
+	unsigned history_count;
+
+	char ai_move[5];	/*move returned by getAImove(), e.g. "E2E4"*/
+
+	unsigned short ai_threads;	/*threads getAImove() splits the root moves between*/
+
+	/*state of the computer player while the move tree is dumped*/
+	int CPU_PLAYER;
+	AIArena arena;
+};
+
+#endif
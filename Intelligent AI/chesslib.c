@@ -1,209 +1,249 @@
 #include "chesslib.h"
+#include "chesslib-bitboard.h"
+#include "chesslib-game.h"
 
 
-#define deleteBlackMoves()                                             \
-{                                                                      \
-    int move_list_piece_index = 0;                                     \
-    while (move_list_piece_index < 6)                                  \
-        deleteMoveList(&b_moves[move_list_piece_index++]);             \
-}
-
-#define deleteWhiteMoves()                                             \
-{                                                                      \
-    int move_list_piece_index = 0;                                     \
-    while (move_list_piece_index < 6)                                  \
-        deleteMoveList(&w_moves[move_list_piece_index++]);             \
-}
-
 #define ALL 0x1eae
 
 
-typedef struct CastlingBool {
-	bool WR_left;	/*white rook at A1*/
-	bool WR_right;	/*white rook at H1*/
-	bool BR_left;	/*black rook at A8*/
-	bool BR_right;	/*black rook at H8*/
-	bool KWhite;	/*white king*/
-	bool KBlack;	/*black king*/
-} CastlingBool;
-
-
 /*********
  *globals*
  *********/
 
-/* Global counters for the total moves each player (Black and White) can do on each round.
- * They get a value after every getMoveList() call. */
-static unsigned white_move_count, black_move_count;
+/*the en passant counters of a game only ever hold 0 or this value*/
+static const unsigned rc = 1;
 
-static unsigned w_enpassant_round_left = 0;
-static unsigned w_enpassant_round_right = 0;
-static unsigned b_enpassant_round_left = 0;
-static unsigned b_enpassant_round_right = 0;
-static bool enpassant = false;
+/*random keys xor-ed together to make the Zobrist key of a position; they are generated
+ *from a fixed seed so that a position gets the same key in every process*/
+static uint64_t zobrist_piece[2][6][64];
+static uint64_t zobrist_castling[64];	/*indexed by _packCastling()*/
+static uint64_t zobrist_enpassant[8];	/*file of a pawn that can be taken en passant*/
+static uint64_t zobrist_black;	/*Black is to move*/
 
-static unsigned rc = 1;
-static unsigned white_removed_moves;
-static unsigned black_removed_moves;
-
-
-CastlingBool check_castling = {true, true, true, true, true, true};
-
-WhiteKing = 1;
-BlackKing = 1;
-
-MoveNode *b_moves[6] = {NULL, NULL, NULL, NULL, NULL, NULL};
-MoveNode *w_moves[6] = {NULL, NULL, NULL, NULL, NULL, NULL};
+static const int piece_value[6] = AI_PIECE_VALUES;
 
 
 /*********************************************
  *prototypes for functions used in chesslib.c*
  *********************************************/
 
+void __attribute__((constructor)) _initZobristKeys();
+uint64_t _randomKey(uint64_t *seed);
+uint64_t _squareKey(ch_template chb[][8], const unsigned short row, const unsigned short col);
+uint64_t _computeKey(const ChessGame *game, ch_template chb[][8], const int color);
+void _countMaterial(ChessGame *game, ch_template chb[][8]);
 void _initChessboard(ch_template chb[][8], unsigned k, char col);
-bool _isOnList(const char *start_move, const char *end_move, const char piece, const int color);
+unsigned char _packCastling(const ChessGame *game);
+void _unpackCastling(ChessGame *game, const unsigned char castling);
+unsigned char _packEnpassant(const ChessGame *game);
+void _unpackEnpassant(ChessGame *game, const unsigned char state);
+bool _isOnList(const ChessGame *game, const char *start_move, const char *end_move, const char piece, const int color);
+void _pushMove(MoveBuffer *buf, const int from, const int to, const int piece);
+void _setMoveViews(MoveNode *views, MoveBuffer *buf);
+int _squareIndex(const char *square);
+int _bbFillMoveLists(ChessGame *game, const Position *pos, const int color);
+void _bbAddCastling(ChessGame *game, const Position *pos, const LegalInfo *info, const int color);
 
 
 /******************************************************************
  *prototypes for functions used in chesslib.c and chlib-computer.c*
  ******************************************************************/
 
-int _fillMoveLists(ch_template chb[][8], MoveNode ***move_array, const int flag);
-void _removeMove(MoveNode **llt, char *st_todel, char *en_todel);
-void _removeThreatsToKing(ch_template chb[][8], int color);
-void _addMove(MoveNode **llt, const char *st, const char *en);
-void _copyBoard(ch_template to[][8], ch_template from[][8]);
-bool _isKingOnTheBoard(ch_template chb[][8], int color);
-bool _makeMove(ch_template chb[][8], char *st_move, char *en_move, const int color, const bool ListCheck);
+void _moveToStrings(const ChessMove move, char *st, char *en);
+int _pieceIndex(const char piece);
+bool _makeMove(ChessGame *game, ch_template chb[][8], char *st_move, char *en_move, const int color, const bool ListCheck, MoveUndo *undo);
+void _unmakeMove(ChessGame *game, ch_template chb[][8], const MoveUndo *undo);
+void _arenaFree(AIArena *arena);
 
 
-void _addMove(MoveNode **llt, const char *st, const char *en)
+void _pushMove(MoveBuffer *buf, const int from, const int to, const int piece)
 {
-	if (!*llt) {
+	if (buf->count < MAX_MOVES)
+		buf->move[buf->count++] = (ChessMove)(from | (to << 6) | (piece << 12));
+}
 
- 		*llt =(MoveNode*) malloc(sizeof(MoveNode));
-		(*llt)->start[2] = (*llt)->end[2] = '\0';
-		(*llt)->start[0] = st[0];
-		(*llt)->start[1] = st[1];
-		(*llt)->end[0] = en[0];
-		(*llt)->end[1] = en[1];
-		(*llt)->nxt = NULL;
-		return;
+int _squareIndex(const char *square)
+{
+	return ('8' - square[1])*8 + (toupper(square[0]) - 'A');
+}
+
+void _moveToStrings(const ChessMove move, char *st, char *en)
+{
+	st[0] = 'A' + (MOVE_FROM(move) & 7);
+	st[1] = '8' - (MOVE_FROM(move) >> 3);
+	en[0] = 'A' + (MOVE_TO(move) & 7);
+	en[1] = '8' - (MOVE_TO(move) >> 3);
+	st[2] = en[2] = '\0';
+}
+
+/*points the six piece views at their moves; the buffer is stably grouped by piece first if needed*/
+void _setMoveViews(MoveNode *views, MoveBuffer *buf)
+{
+	unsigned short start[7] = {0, 0, 0, 0, 0, 0, 0};
+	bool grouped = true;
+
+	for (int i = 0; i < buf->count; i++) {
+		start[MOVE_PIECE(buf->move[i]) + 1]++;
+		if (i && MOVE_PIECE(buf->move[i]) < MOVE_PIECE(buf->move[i-1]))
+			grouped = false;
+	}
+	for (int i = 0; i < 6; i++)
+		start[i+1] += start[i];
+	for (int i = 0; i < 6; i++) {
+		views[i].move = &buf->move[start[i]];
+		views[i].count = start[i+1] - start[i];
+	}
+	if (!grouped) {
+		ChessMove sorted[MAX_MOVES];
+		for (int i = 0; i < buf->count; i++)
+			sorted[start[MOVE_PIECE(buf->move[i])]++] = buf->move[i];
+		memcpy(buf->move, sorted, buf->count*sizeof(ChessMove));
 	}
-	MoveNode *curr = *llt, *new = malloc(sizeof(MoveNode));
-	while (curr->nxt)
-		curr = curr->nxt;
-	new->start[2] = new->end[2] = '\0';
-	new->start[0] = st[0];
-	new->start[1] = st[1];
-	new->end[0] = en[0];
-	new->end[1] = en[1];
-	new->nxt = NULL;
-	curr->nxt = new;
 }
 
-void printMoveList(MoveNode *llt, FILE *fd)
+void printMoveList(const MoveNode *llt, FILE *fd)
 {
-	if (!llt) {
+	if (!llt->count) {
 		fprintf(stderr, "No moves.\n");
 		return;
 	}
-	MoveNode *curr = llt;
-	short unsigned i = 0;
-	while (i++, curr) {
-		fprintf(fd, "%s -> %s", curr->start, curr->end);
-		curr = curr->nxt;
-		if (!(i%5) && curr)
-			printf("\n");
-		else if (curr)
-			printf("     ");
+	char st[3], en[3];
+	for (unsigned short i = 0; i < llt->count; i++) {
+		_moveToStrings(llt->move[i], st, en);
+		fprintf(fd, "%s -> %s", st, en);
+		if (!((i+1)%5) && i+1 < llt->count)
+			fprintf(fd, "\n");
+		else if (i+1 < llt->count)
+			fprintf(fd, "     ");
 	}
-	printf("\n");
+	fprintf(fd, "\n");
 }
 
-void _removeMove(MoveNode **llt, char *st_todel, char *en_todel)
+/*index of a piece letter in the move lists, or -1 for NOPIECE*/
+int _pieceIndex(const char piece)
 {
-	MoveNode *curr = (*llt), *prv = NULL;
-	while (curr) {
-		if (!strncmp(st_todel, curr->start, 3) && !strncmp(en_todel, curr->end, 3)) {
-			if (prv)
-				prv->nxt = curr->nxt;
-			else
-				(*llt) = (*llt)->nxt;
-			free(curr);
-			return;
-		}
-		prv = curr;
-		curr = curr->nxt;
+	switch (piece) {
+		case PAWN:
+			return 0;
+		case KING:
+			return 1;
+		case QUEEN:
+			return 2;
+		case ROOK:
+			return 3;
+		case KNIGHT:
+			return 4;
+		case BISHOP:
+			return 5;
+		default:
+			return -1;
 	}
-	fprintf(stderr, "ERROR: %s -> %s not found\n", st_todel, en_todel);
 }
 
-void deleteMoveList(MoveNode **llt)
+/*xorshift64*, good enough for keys that only need to look random*/
+uint64_t _randomKey(uint64_t *seed)
+{
+	*seed ^= *seed >> 12;
+	*seed ^= *seed << 25;
+	*seed ^= *seed >> 27;
+	return *seed * 0x2545f4914f6cdd1dULL;
+}
+
+void _initZobristKeys()
 {
-	MoveNode *curr = (*llt);
-	while ((*llt)) {
-		(*llt) = (*llt)->nxt;
-		free(curr);
-		curr = (*llt);
+	uint64_t seed = 0x9e3779b97f4a7c15ULL;
+
+	for (int c = 0; c < 2; c++)
+		for (int piece = 0; piece < 6; piece++)
+			for (int sq = 0; sq < 64; sq++)
+				zobrist_piece[c][piece][sq] = _randomKey(&seed);
+	zobrist_castling[0] = 0;
+	for (int i = 1; i < 64; i++)
+		zobrist_castling[i] = _randomKey(&seed);
+	for (int i = 0; i < 8; i++)
+		zobrist_enpassant[i] = _randomKey(&seed);
+	zobrist_black = _randomKey(&seed);
+}
+
+/*key of the piece standing on a square, 0 if it's empty*/
+uint64_t _squareKey(ch_template chb[][8], const unsigned short row, const unsigned short col)
+{
+	int idx = _pieceIndex(chb[row][col].current);
+
+	return (idx < 0)?0:zobrist_piece[BB_SIDE(chb[row][col].c)][idx][row*8 + col];
+}
+
+/*key of a whole position, computed from scratch; _makeMove keeps game->key up to date instead*/
+uint64_t _computeKey(const ChessGame *game, ch_template chb[][8], const int color)
+{
+	uint64_t key = zobrist_castling[_packCastling(game)];
+
+	for (int row = 0; row < 8; row++)
+		for (int col = 0; col < 8; col++)
+			key ^= _squareKey(chb, row, col);
+	if (game->enpassant)
+		key ^= zobrist_enpassant[game->enpassant_file];
+	if (color == BLACK)
+		key ^= zobrist_black;
+	return key;
+}
+
+/*piece counts and material of a whole position, from scratch; _makeMove keeps them up to date instead*/
+void _countMaterial(ChessGame *game, ch_template chb[][8])
+{
+	memset(game->piece_count, 0, sizeof game->piece_count);
+	memset(game->material, 0, sizeof game->material);
+	for (int row = 0; row < 8; row++) {
+		for (int col = 0; col < 8; col++) {
+			int idx = _pieceIndex(chb[row][col].current);
+			if (idx < 0)
+				continue;
+			game->piece_count[BB_SIDE(chb[row][col].c)][idx]++;
+			game->material[BB_SIDE(chb[row][col].c)] += piece_value[idx];
+		}
 	}
 }
 
-bool _isOnList(const char *start_move, const char *end_move, const char piece, const int color)
+void deleteMoveList(MoveNode *llt)
 {
-	unsigned short idx;
-	MoveNode *curr;
+	llt->count = 0;
+}
+
+bool _isOnList(const ChessGame *game, const char *start_move, const char *end_move, const char piece, const int color)
+{
+	int idx = _pieceIndex(piece);
+	const MoveNode *view;
 	if (end_move && start_move) {
-		switch (piece) {
-			case PAWN:
-				idx = 0;
-				break;
-			case KING:
-				idx = 1;
-				break;
-			case QUEEN:
-				idx = 2;
-				break;
-			case ROOK:
-				idx = 3;
-				break;
-			case KNIGHT:
-				idx = 4;
-				break;
-			case BISHOP:
-				idx = 5;
-				break;
-			default:
-				return false;
-		}
+		if (idx < 0)
+			return false;
 		switch (color) {
 			case BLACK:
-				curr = b_moves[idx];
+				view = &game->b_moves[idx];
 				break;
 			case WHITE:
-				curr = w_moves[idx];
+				view = &game->w_moves[idx];
 				break;
 			default:
 				return false;
 		}
-		while (curr) {
-			if (!strncmp(end_move, curr->end, 2) && !strncmp(start_move, curr->start, 2)) {
+		int from = _squareIndex(start_move), to = _squareIndex(end_move);
+		for (unsigned short i = 0; i < view->count; i++) {
+			if (MOVE_FROM(view->move[i]) == from && MOVE_TO(view->move[i]) == to) {
 				return true;
 			}
-			curr = curr->nxt;
 		}
 	}
 	return false;
 }
 
-void deleteMoves()
+void deleteMoves(ChessGame *game)
 {
-	deleteBlackMoves();
-	deleteWhiteMoves();
 	for (int i = 0; i < 6; i++) {
-		b_moves[i] = NULL;
-		w_moves[i] = NULL;
+		deleteMoveList(&game->b_moves[i]);
+		deleteMoveList(&game->w_moves[i]);
 	}
+	game->black_buffer.count = 0;
+	game->white_buffer.count = 0;
 }
 
 void _initChessboard(ch_template chb[][8], unsigned k, char col)	/*k is row, col is column*/
@@ -253,501 +293,176 @@ void _initChessboard(ch_template chb[][8], unsigned k, char col)	/*k is row, col
 		return _initChessboard(chb, k, col);
 }
 
-void initChessboard(ch_template chb[][8])
+ChessGame *createChessGame(void)
 {
-	return _initChessboard(chb, 0, 'A');
+	ChessGame *game = calloc(1, sizeof(ChessGame));
+
+	if (!game)
+		return NULL;
+	game->WhiteKing = safe;
+	game->BlackKing = safe;
+	game->check_castling = (CastlingBool){true, true, true, true, true, true};
+	game->arena.limit = AI_ARENA_LIMIT;
+	game->ai_threads = 1;
+	return game;
 }
 
-int getAllMoves(ch_template chb[][8], int c_flag)
+void deleteChessGame(ChessGame *game)
 {
-	deleteMoves();
-	int total_move_count = _fillMoveLists(chb, NULL, ALL);
-	unsigned b_tmp = black_move_count, w_tmp = white_move_count;
+	if (!game)
+		return;
+	_arenaFree(&game->arena);
+	free(game);
+}
 
-	white_removed_moves = 0;
-	black_removed_moves = 0;
+void setAIMemoryLimit(ChessGame *game, size_t bytes)
+{
+	game->arena.limit = bytes;
+}
+
+void setAIThreads(ChessGame *game, unsigned short threads)
+{
+	if (!threads)
+		threads = 1;
+	game->ai_threads = (threads > AI_MAX_THREADS)?AI_MAX_THREADS:threads;
+}
 
-	_removeThreatsToKing(chb, c_flag);
+const MoveNode *getMoveList(const ChessGame *game, const int color)
+{
+	return (color == BLACK)?game->b_moves:game->w_moves;
+}
+
+KingState getKingState(const ChessGame *game, const int color)
+{
+	return (color == BLACK)?game->BlackKing:game->WhiteKing;
+}
 
-	b_tmp -= black_removed_moves;
-	w_tmp -= white_removed_moves;
-	black_move_count = b_tmp;
-	white_move_count = w_tmp;
-	if (!black_move_count)
-		BlackKing = checkmate;
-	if (!white_move_count)
-		WhiteKing = checkmate;
+uint64_t getZobristKey(const ChessGame *game)
+{
+	return game->key;
+}
+
+void initChessboard(ChessGame *game, ch_template chb[][8])
+{
+	game->check_castling = (CastlingBool){true, true, true, true, true, true};
+	_unpackEnpassant(game, 0);
+	game->history_count = 0;
+	_initChessboard(chb, 0, 'A');
+	game->key = _computeKey(game, chb, WHITE);
+	_countMaterial(game, chb);
+}
+
+int getAllMoves(ChessGame *game, ch_template chb[][8], int c_flag)
+{
+	Position pos;
+
+	deleteMoves(game);
+	_loadPosition(&pos, chb);
+
+	int total_move_count = _bbFillMoveLists(game, &pos, c_flag);
+	_setMoveViews(game->b_moves, &game->black_buffer);
+	_setMoveViews(game->w_moves, &game->white_buffer);
+
+	if (!game->black_move_count)
+		game->BlackKing = checkmate;
+	if (!game->white_move_count)
+		game->WhiteKing = checkmate;
 	return total_move_count;
 }
 
-int _fillMoveLists(ch_template chb[][8], MoveNode ***move_array, int flag)
+/*fills the move buffers of both colors; only the moves of 'color' are checked for legality,
+ *using the pinned pieces and check evasions of its King instead of playing every move*/
+int _bbFillMoveLists(ChessGame *game, const Position *pos, const int color)
 {
-	int i, j, k, l, move_count = 0;
-	char t_st[3], t_en[3];
-	MoveNode **black_m = NULL, **white_m = NULL;
+	LegalInfo info;
 
-	if (flag == ALL) {
-		black_m = b_moves;
-		white_m = w_moves;
+	_bbLegalInfo(pos, BB_SIDE(color), &info);
+	if (color == BLACK) {
+		game->BlackKing = (info.checkers)?check:safe;
 	} else {
-		if (flag == BLACK) {
-			black_m = *move_array;
-		} else {
-			white_m = *move_array;
-		}
+		game->WhiteKing = (info.checkers)?check:safe;
 	}
-
-	black_move_count = 0;
-	white_move_count = 0;
-	t_en[2] = t_st[2] = '\0';
-	for (i = 0; i < 8; i++) {
-		for (j = 0; j < 8; j++) {
-			t_st[0] = chb[i][j].square[0];
-			t_st[1] = chb[i][j].square[1];
-			if (chb[i][j].current == PAWN) {
-				if (chb[i][j].c == BLACK && (flag == ALL || flag == BLACK)) {
-					if (i == 1) {
-						if (!(chb[i+2][j].occ) && !(chb[i+1][j].occ)) {
-							t_en[0] = chb[i+2][j].square[0];
-							t_en[1] = chb[i+2][j].square[1];
-							_addMove(&black_m[0], t_st, t_en);
-							black_move_count++;
-							move_count++;
-						}
-					}
-					/*if (i == 3) {
-						if (w_enpassant_round_left) {
-							if (chb[i][j+1].current == 'P' && chb[i][j+1].c == WHITE) {
-								t_en[0] = chb[i+1][j+1].square[0];
-								t_en[1] = chb[i+1][j+1].square[1];
-								_addMove(&black_m[0], t_st, t_en);
-								black_move_count++;
-								move_count++;
-							}
-						} else if (w_enpassant_round_right) {
-							if (chb[i][j-1].current == 'P' && chb[i][j-1].c == WHITE) {
-								t_en[0] = chb[i+1][j-1].square[0];
-								t_en[1] = chb[i+1][j-1].square[1];
-								_addMove(&black_m[0], t_st, t_en);
-								black_move_count++;
-								move_count++;
-							}
-						}
-					}*/
-					if (i + 1 <= 7) {
-						t_en[1] = chb[i+1][j].square[1];
-						if (chb[i+1][j].occ == false) {
-							t_en[0] = chb[i+1][j].square[0];
-							_addMove(&black_m[0], t_st, t_en);
-							black_move_count++;
-							move_count++;
-						}
-						if (j + 1 <= 7) {
-							if (chb[i+1][j+1].c == WHITE) {
-								t_en[0] = chb[i+1][j+1].square[0];
-								_addMove(&black_m[0], t_st, t_en);
-								black_move_count++;
-								move_count++;
-							}
-						}
-						if (j - 1 >= 0) {
-							if (chb[i+1][j-1].c == WHITE) {
-								t_en[0] = chb[i+1][j-1].square[0];
-								_addMove(&black_m[0], t_st, t_en);
-								black_move_count++;
-								move_count++;
-							}
-						}
-					}
-				} else if (chb[i][j].c == WHITE && (flag == ALL || flag == WHITE)) {
-					if (i == 6) {
-						if (!(chb[i-2][j].occ) && !(chb[i-1][j].occ)) {
-							t_en[0] = chb[i-2][j].square[0];
-							t_en[1] = chb[i-2][j].square[1];
-							_addMove(&white_m[0], t_st, t_en);
-							white_move_count++;
-							move_count++;
-						}
-					}
-					/*if (i == 4) {
-						if (b_enpassant_round_left) {
-							if (chb[i][j+1].current == 'P' && chb[i][j+1].c == BLACK) {
-								t_en[0] = chb[i-1][j+1].square[0];
-								t_en[1] = chb[i-1][j+1].square[1];
-								_addMove(&white_m[0], t_st, t_en);
-								white_move_count++;
-								move_count++;
-							}
-						} else if (b_enpassant_round_right) {
-							if (chb[i][j-1].current == 'P' && chb[i][j-1].c == BLACK) {
-								t_en[0] = chb[i-1][j-1].square[0];
-								t_en[1] = chb[i-1][j-1].square[1];
-								_addMove(&white_m[0], t_st, t_en);
-								white_move_count++;
-								move_count++;
-							}
-						}
-					}*/
-					if (i - 1 >= 0) {
-						t_en[1] = chb[i-1][j].square[1];
-						if (chb[i-1][j].occ == false) {
-							t_en[0] = chb[i-1][j].square[0];
-							_addMove(&white_m[0], t_st, t_en);
-							white_move_count++;
-							move_count++;
-						}
-						if (j + 1 <= 7) {
-							if (chb[i-1][j+1].c == BLACK) {
-								t_en[0] = chb[i-1][j+1].square[0];
-								_addMove(&white_m[0], t_st, t_en);
-								white_move_count++;
-								move_count++;
-							}
-						}
-						if (j - 1 >= 0) {
-							if (chb[i-1][j-1].c == BLACK) {
-								t_en[0] = chb[i-1][j-1].square[0];
-								_addMove(&white_m[0], t_st, t_en);
-								white_move_count++;
-								move_count++;
-							}
-						}
-					}
-				}
-			}
-			if (chb[i][j].current == ROOK || chb[i][j].current == QUEEN) {
-				k = i;
-				for (l = j+1; l <= 7; l++) {
-					if (chb[k][l].c == chb[i][j].c)
-						break;
-					t_en[0] = chb[k][l].square[0];
-					t_en[1] = chb[k][l].square[1];
-					if (chb[i][j].c == BLACK && (flag == ALL || flag == BLACK)) {
-						if (chb[i][j].current == ROOK) {
-							_addMove(&black_m[3], t_st, t_en);
-							black_move_count++;
-							move_count++;
-						} else {
-							_addMove(&black_m[2], t_st, t_en);
-							black_move_count++;
-							move_count++;
-						}
-					} else if (chb[i][j].c == WHITE && (flag == ALL || flag == WHITE)) {
-						if (chb[i][j].current == ROOK) {
-							_addMove(&white_m[3], t_st, t_en);
-							white_move_count++;
-							move_count++;
-						} else {
-							_addMove(&white_m[2], t_st, t_en);
-							white_move_count++;
-							move_count++;
-						}
-					}
-					if (chb[k][l].occ)
-						break;
-				}
-				for (l = j-1; l >= 0; l--) {
-					if (chb[k][l].c == chb[i][j].c)
-						break;
-					t_en[0] = chb[k][l].square[0];
-					t_en[1] = chb[k][l].square[1];
-					if (chb[i][j].c == BLACK && (flag == ALL || flag == BLACK)) {
-						if (chb[i][j].current == ROOK) {
-							_addMove(&black_m[3], t_st, t_en);
-							black_move_count++;
-							move_count++;
-						} else {
-							_addMove(&black_m[2], t_st, t_en);
-							black_move_count++;
-							move_count++;
-						}
-					} else if (chb[i][j].c == WHITE && (flag == ALL || flag == WHITE)) {
-						if (chb[i][j].current == ROOK) {
-							_addMove(&white_m[3], t_st, t_en);
-							white_move_count++;
-							move_count++;
-						} else {
-							_addMove(&white_m[2], t_st, t_en);
-							white_move_count++;
-							move_count++;
-						}
-					}
-					if (chb[k][l].occ)
-						break;
-				}
-
-				l = j;
-				for (k = i+1; k <= 7; k++) {
-					if (chb[k][l].c == chb[i][j].c)
-						break;
-					t_en[0] = chb[k][l].square[0];
-					t_en[1] = chb[k][l].square[1];
-					if (chb[i][j].c == BLACK && (flag == ALL || flag == BLACK)) {
-						if (chb[i][j].current == ROOK) {
-							_addMove(&black_m[3], t_st, t_en);
-							black_move_count++;
-							move_count++;
-						} else {
-							_addMove(&black_m[2], t_st, t_en);
-							black_move_count++;
-							move_count++;
-						}
-					} else if (chb[i][j].c == WHITE && (flag == ALL || flag == WHITE)) {
-						if (chb[i][j].current == ROOK) {
-							_addMove(&white_m[3], t_st, t_en);
-							white_move_count++;
-							move_count++;
-						} else {
-							_addMove(&white_m[2], t_st, t_en);
-							white_move_count++;
-							move_count++;
-						}
-					}
-					if (chb[k][l].occ)
-						break;
-				}
-				for (k = i-1; k >= 0; k--) {
-					if (chb[k][l].c == chb[i][j].c)
-						break;
-					t_en[0] = chb[k][l].square[0];
-					t_en[1] = chb[k][l].square[1];
-					if (chb[i][j].c == BLACK && (flag == ALL || flag == BLACK)) {
-						if (chb[i][j].current == ROOK) {
-							_addMove(&black_m[3], t_st, t_en);
-							black_move_count++;
-							move_count++;
-						} else {
-							_addMove(&black_m[2], t_st, t_en);
-							black_move_count++;
-							move_count++;
-						}
-					} else if (chb[i][j].c == WHITE && (flag == ALL || flag == WHITE)) {
-						if (chb[i][j].current == ROOK) {
-							_addMove(&white_m[3], t_st, t_en);
-							white_move_count++;
-							move_count++;
-						} else {
-							_addMove(&white_m[2], t_st, t_en);
-							white_move_count++;
-							move_count++;
-						}
-					}
-					if (chb[k][l].occ)
-						break;
-				}
-			}
-			if (chb[i][j].current == BISHOP || chb[i][j].current == QUEEN) {
-				k = i - 1;
-				l = j - 1;
-				while ((k <= 7 && k >= 0) && (l >= 0 && l <= 7)) {
-					if (chb[k][l].c != chb[i][j].c) {
-						t_en[0] = chb[k][l].square[0];
-						t_en[1] = chb[k][l].square[1];
-						if (chb[i][j].c == BLACK && (flag == ALL || flag == BLACK)) {
-							if (chb[i][j].current == BISHOP) {
-								_addMove(&black_m[5], t_st, t_en);
-								black_move_count++;
-								move_count++;
-							} else {
-								_addMove(&black_m[2], t_st, t_en);
-								black_move_count++;
-								move_count++;
-							}
-						} else if (chb[i][j].c == WHITE && (flag == ALL || flag == WHITE)) {
-							if (chb[i][j].current == BISHOP) {
-								_addMove(&white_m[5], t_st, t_en);
-								white_move_count++;
-								move_count++;
-							} else {
-								_addMove(&white_m[2], t_st, t_en);
-								white_move_count++;
-								move_count++;
-							}
-						}
-					}
-					if (chb[k][l].occ)
-						break;
-					k--;
-					l--;
-				}
-				k = i - 1;
-				l = j + 1;
-				while ((k >= 0 && k <= 7) && (l <= 7 && l >= 0)) {
-					if (chb[k][l].c != chb[i][j].c) {
-						t_en[0] = chb[k][l].square[0];
-						t_en[1] = chb[k][l].square[1];
-						if (chb[i][j].c == BLACK && (flag == ALL || flag == BLACK)) {
-							if (chb[i][j].current == BISHOP) {
-								_addMove(&black_m[5], t_st, t_en);
-								black_move_count++;
-								move_count++;
-							} else {
-								_addMove(&black_m[2], t_st, t_en);
-								black_move_count++;
-								move_count++;
-							}
-						} else if (chb[i][j].c == WHITE && (flag == ALL || flag == WHITE)) {
-							if (chb[i][j].current == BISHOP) {
-								_addMove(&white_m[5], t_st, t_en);
-								white_move_count++;
-								move_count++;
-							} else {
-								_addMove(&white_m[2], t_st, t_en);
-								white_move_count++;
-								move_count++;
-							}
-						}
-					}
-					if (chb[k][l].occ)
-						break;
-					k--;
-					l++;
-				}
-				k = i + 1;
-				l = j - 1;
-				while ((k <= 7 && k >= 0) && (l >= 0 && l <= 7)) {
-					if (chb[k][l].c != chb[i][j].c) {
-						t_en[0] = chb[k][l].square[0];
-						t_en[1] = chb[k][l].square[1];
-						if (chb[i][j].c == BLACK && (flag == ALL || flag == BLACK)) {
-							if (chb[i][j].current == BISHOP) {
-								_addMove(&black_m[5], t_st, t_en);
-								black_move_count++;
-								move_count++;
-							} else {
-								_addMove(&black_m[2], t_st, t_en);
-								black_move_count++;
-								move_count++;
-							}
-						} else if (chb[i][j].c == WHITE && (flag == ALL || flag == WHITE)) {
-							if (chb[i][j].current == BISHOP) {
-								_addMove(&white_m[5], t_st, t_en);
-								white_move_count++;
-								move_count++;
-							} else {
-								_addMove(&white_m[2], t_st, t_en);
-								white_move_count++;
-								move_count++;
-							}
-						}
-					}
-					if (chb[k][l].occ)
-						break;
-					k++;
-					l--;
-				}
-				k = i + 1;
-				l = j + 1;
-				while ((k <= 7 && k >= 0) && (l <= 7 && l >= 0)) {
-					if (chb[k][l].c != chb[i][j].c) {
-						t_en[0] = chb[k][l].square[0];
-						t_en[1] = chb[k][l].square[1];
-						if (chb[i][j].c == BLACK && (flag == ALL || flag == BLACK)) {
-							if (chb[i][j].current == BISHOP) {
-								_addMove(&black_m[5], t_st, t_en);
-								black_move_count++;
-								move_count++;
-							} else {
-								_addMove(&black_m[2], t_st, t_en);
-								black_move_count++;
-								move_count++;
-							}
-						} else if (chb[i][j].c == WHITE && (flag == ALL || flag == WHITE)) {
-							if (chb[i][j].current == BISHOP) {
-								_addMove(&white_m[5], t_st, t_en);
-								white_move_count++;
-								move_count++;
-							} else {
-								_addMove(&white_m[2], t_st, t_en);
-								white_move_count++;
-								move_count++;
-							}
-						}
-					}
-					if (chb[k][l].occ)
-						break;
-					k++;
-					l++;
-				}
-			}
-			if (chb[i][j].current == KING) {
-				for (k = i - 1; k < i + 2; k++){
-					for (l = j - 1; l < j + 2; l++){
-						if (k > 7 || k < 0 || l > 7 || l < 0)
-							continue;
-						if ((i == k && j == l) || chb[k][l].c == chb[i][j].c)
-							continue;
-						t_en[0] = chb[k][l].square[0];
-						t_en[1] = chb[k][l].square[1];
-						if (chb[i][j].c == BLACK && (flag == ALL || flag == BLACK)) {
-							_addMove(&black_m[1], t_st, t_en);
-							black_move_count++;
-							move_count++;
-						} else if (chb[i][j].c == WHITE && (flag == ALL || flag == WHITE)) {
-							_addMove(&white_m[1], t_st, t_en);
-							white_move_count++;
-							move_count++;
-						}
-					}
-				}
-			}
-			if (chb[i][j].current == KNIGHT) {
-				int knightrow[] = {i-2,i-2,i-1,i-1,i+1,i+1,i+2,i+2};
-				int knightcol[] = {j-1,j+1,j-2,j+2,j-2,j+2,j-1,j+1};
-				int count = 0;
-				for (; count < 8; count++) {
-					if (knightrow[count] > -1 && knightrow[count] < 8
-						&& knightcol[count] > -1 && knightcol[count] < 8) {
-						if (chb[knightrow[count]][knightcol[count]].c != chb[i][j].c) {
-							t_en[0] = chb[knightrow[count]][knightcol[count]].square[0];
-							t_en[1] = chb[knightrow[count]][knightcol[count]].square[1];
-							if (chb[i][j].c == BLACK && (flag == ALL || flag == BLACK)) {
-								_addMove(&black_m[4], t_st, t_en);
-								black_move_count++;
-								move_count++;
-							} else if (chb[i][j].c == WHITE && (flag == ALL || flag == WHITE)) {
-								_addMove(&white_m[4], t_st, t_en);
-								white_move_count++;
-								move_count++;
-							}
-						}
-					}
-				}
+	for (int side = 0; side < 2; side++) {
+		int curr_color = (side == BB_SIDE(BLACK))?BLACK:WHITE;
+		MoveBuffer *moves = (curr_color == BLACK)?&game->black_buffer:&game->white_buffer;
+
+		for (int piece = 0; piece < BB_PIECES; piece++) {
+			Bitboard pieces = pos->piece[side][piece];
+			while (pieces) {
+				int from = _bbPopLsb(&pieces);
+				Bitboard targets = (curr_color == color)?_bbLegalMoves(pos, &info, piece, from, side)
+					:_bbPieceMoves(pos, piece, from, side);
+				while (targets)
+					_pushMove(moves, from, _bbPopLsb(&targets), piece);
 			}
+			if (piece == BB_KING && curr_color == color)
+				_bbAddCastling(game, pos, &info, curr_color);
 		}
 	}
-	if (flag == ALL || flag == BLACK) {
-		if (check_castling.KBlack && BlackKing != check) {
-			if (check_castling.BR_left) {
-				if (!chb[0][1].occ && !chb[0][2].occ && !chb[0][3].occ) {
-					_addMove(&black_m[1], "E8", "C8");
-				}
-			}
-			if (check_castling.BR_right) {
-				if (!chb[0][5].occ && !chb[0][6].occ) {
-					_addMove(&black_m[1], "E8", "G8");
-				}
-			}
-		}
+	game->black_move_count = game->black_buffer.count;
+	game->white_move_count = game->white_buffer.count;
+	return game->black_move_count + game->white_move_count;
+}
+
+/*castling needs the King and the rook unmoved, the squares between them empty, and the King
+ *not in check nor passing through or landing on an attacked square*/
+void _bbAddCastling(ChessGame *game, const Position *pos, const LegalInfo *info, const int color)
+{
+	int row = (color == BLACK)?0:7, side = BB_SIDE(color);
+	MoveBuffer *moves = (color == BLACK)?&game->black_buffer:&game->white_buffer;
+	bool rook_left = (color == BLACK)?game->check_castling.BR_left:game->check_castling.WR_left;
+	bool rook_right = (color == BLACK)?game->check_castling.BR_right:game->check_castling.WR_right;
+	bool king = (color == BLACK)?game->check_castling.KBlack:game->check_castling.KWhite;
+
+	if (!king || info->king != BB_SQUARE(row, 4) || info->checkers)
+		return;
+	if (rook_left && (pos->piece[side][BB_ROOK] & BB_BIT(BB_SQUARE(row, 0)))
+		&& !(pos->occupied & (BB_BIT(BB_SQUARE(row, 1)) | BB_BIT(BB_SQUARE(row, 2)) | BB_BIT(BB_SQUARE(row, 3))))
+		&& !_bbIsAttacked(pos, BB_SQUARE(row, 3), !side) && !_bbIsAttacked(pos, BB_SQUARE(row, 2), !side)) {
+		_pushMove(moves, BB_SQUARE(row, 4), BB_SQUARE(row, 2), BB_KING);
 	}
-	if (flag == ALL || flag == WHITE) {
-		if (check_castling.KWhite && WhiteKing != check) {
-			if (check_castling.WR_left) {
-				if (!chb[7][1].occ && !chb[7][2].occ && !chb[7][3].occ) {
-					_addMove(&white_m[1], "E1", "C1");
-				}
-			}
-			if (check_castling.WR_right) {
-				if (!chb[7][5].occ && !chb[7][6].occ) {
-					_addMove(&white_m[1], "E1", "G1");
-				}
-			}
-		}
+	if (rook_right && (pos->piece[side][BB_ROOK] & BB_BIT(BB_SQUARE(row, 7)))
+		&& !(pos->occupied & (BB_BIT(BB_SQUARE(row, 5)) | BB_BIT(BB_SQUARE(row, 6))))
+		&& !_bbIsAttacked(pos, BB_SQUARE(row, 5), !side) && !_bbIsAttacked(pos, BB_SQUARE(row, 6), !side)) {
+		_pushMove(moves, BB_SQUARE(row, 4), BB_SQUARE(row, 6), BB_KING);
 	}
-	return move_count;
 }
 
-bool _makeMove(ch_template chb[][8], char *st_move, char *en_move, const int color, const bool ListCheck)
+unsigned char _packCastling(const ChessGame *game)
+{
+	return game->check_castling.WR_left | game->check_castling.WR_right << 1 | game->check_castling.BR_left << 2
+		| game->check_castling.BR_right << 3 | game->check_castling.KWhite << 4 | game->check_castling.KBlack << 5;
+}
+
+void _unpackCastling(ChessGame *game, const unsigned char castling)
+{
+	game->check_castling.WR_left = castling & 1;
+	game->check_castling.WR_right = castling >> 1 & 1;
+	game->check_castling.BR_left = castling >> 2 & 1;
+	game->check_castling.BR_right = castling >> 3 & 1;
+	game->check_castling.KWhite = castling >> 4 & 1;
+	game->check_castling.KBlack = castling >> 5 & 1;
+}
+
+unsigned char _packEnpassant(const ChessGame *game)
+{
+	return (game->w_enpassant_round_left != 0) | (game->w_enpassant_round_right != 0) << 1
+		| (game->b_enpassant_round_left != 0) << 2 | (game->b_enpassant_round_right != 0) << 3 | game->enpassant << 4
+		| game->enpassant_file << 5;
+}
+
+void _unpackEnpassant(ChessGame *game, const unsigned char state)
+{
+	game->w_enpassant_round_left = (state & 1)?rc:0;
+	game->w_enpassant_round_right = (state >> 1 & 1)?rc:0;
+	game->b_enpassant_round_left = (state >> 2 & 1)?rc:0;
+	game->b_enpassant_round_right = (state >> 3 & 1)?rc:0;
+	game->enpassant = state >> 4 & 1;
+	game->enpassant_file = state >> 5;
+}
+
+/*plays a move on chb; if undo isn't NULL it gets what _unmakeMove needs to take the move back*/
+bool _makeMove(ChessGame *game, ch_template chb[][8], char *st_move, char *en_move, const int color, const bool ListCheck, MoveUndo *undo)
 {
 	if (!en_move || !st_move)
 		return false;
@@ -770,58 +485,94 @@ bool _makeMove(ch_template chb[][8], char *st_move, char *en_move, const int col
 		return false;
 
 	if (ListCheck) {
-		if (!_isOnList(st_move, en_move, piece, color))
+		if (!_isOnList(game, st_move, en_move, piece, color))
 			return false;
 	}
 
-	b_enpassant_round_left = 0;
-	b_enpassant_round_right = 0;
-	w_enpassant_round_left = 0;
-	w_enpassant_round_right = 0;
-	enpassant = false;
+	if (undo) {
+		undo->from = starty*8 + startx;
+		undo->to = endy*8 + endx;
+		undo->captured = chb[endy][endx].current;
+		undo->castling = _packCastling(game);
+		undo->enpassant = _packEnpassant(game);
+		undo->key = game->key;
+	}
+
+	/*the key loses the old castling and en passant state here and gets the new one at the end*/
+	uint64_t key = game->key ^ zobrist_black ^ zobrist_castling[_packCastling(game)];
+	if (game->enpassant)
+		key ^= zobrist_enpassant[game->enpassant_file];
+	key ^= _squareKey(chb, starty, startx) ^ _squareKey(chb, endy, endx)
+		^ zobrist_piece[BB_SIDE(color)][_pieceIndex(piece)][endy*8 + endx];
+	if (piece == KING && startx == 4 && (endx == 2 || endx == 6)) {
+		unsigned short row = (color == BLACK)?0:7, rook_from = (endx == 2)?0:7, rook_to = (endx == 2)?3:5;
+		key ^= _squareKey(chb, row, rook_from) ^ _squareKey(chb, row, rook_to)
+			^ zobrist_piece[BB_SIDE(color)][3][row*8 + rook_to];
+	}
+
+	if (chb[endy][endx].current != NOPIECE) {
+		int side = BB_SIDE(chb[endy][endx].c), idx = _pieceIndex(chb[endy][endx].current);
+		game->piece_count[side][idx]--;
+		game->material[side] -= piece_value[idx];
+	}
+
+	game->b_enpassant_round_left = 0;
+	game->b_enpassant_round_right = 0;
+	game->w_enpassant_round_left = 0;
+	game->w_enpassant_round_right = 0;
+	game->enpassant = false;
+	game->enpassant_file = 0;
 	if (piece == PAWN) {
 		if (color == BLACK) {
 			if (starty == 1 && endy == 3) {
-				if (chb[endy][endx+1].current == PAWN && chb[endy][endx+1].c == WHITE) {
-					b_enpassant_round_right = rc;
-					enpassant = true;
+				if (endx < 7 && chb[endy][endx+1].current == PAWN && chb[endy][endx+1].c == WHITE) {
+					game->b_enpassant_round_right = rc;
+					game->enpassant = true;
+					game->enpassant_file = endx;
 				}
-				if (chb[endy][endx-1].current == PAWN && chb[endy][endx-1].c == WHITE) {
-					b_enpassant_round_left = rc;
-					enpassant = true;
+				if (endx > 0 && chb[endy][endx-1].current == PAWN && chb[endy][endx-1].c == WHITE) {
+					game->b_enpassant_round_left = rc;
+					game->enpassant = true;
+					game->enpassant_file = endx;
 				}
 			}
 		} else {
 			if (starty == 6 && endy == 4) {
-				if (chb[endy][endx+1].current == PAWN && chb[endy][endx+1].c == BLACK) {
-					w_enpassant_round_right = rc;
-					enpassant = true;
+				if (endx < 7 && chb[endy][endx+1].current == PAWN && chb[endy][endx+1].c == BLACK) {
+					game->w_enpassant_round_right = rc;
+					game->enpassant = true;
+					game->enpassant_file = endx;
 				}
-				if (chb[endy][endx-1].current == PAWN && chb[endy][endx-1].c == BLACK) {
-					w_enpassant_round_left = rc;
-					enpassant = true;
+				if (endx > 0 && chb[endy][endx-1].current == PAWN && chb[endy][endx-1].c == BLACK) {
+					game->w_enpassant_round_left = rc;
+					game->enpassant = true;
+					game->enpassant_file = endx;
 				}
 			}
 		}
 	}
 
-	if (piece == ROOK) {
-		if (startx == 0) {
-			if (starty == 0)
-				check_castling.BR_left = false;
-			else if (starty == 7)
-				check_castling.BR_right = false;
-		} else if (startx == 7) {
-			if (starty == 0)
-				check_castling.WR_left = false;
-			else if (starty == 7)
-				check_castling.WR_right = false;
+	/*a rook that moves or gets captured can't castle anymore*/
+	for (int i = 0; i < 2; i++) {
+		unsigned short x = (i)?endx:startx, y = (i)?endy:starty;
+		if (i == 0 && piece != ROOK)
+			continue;
+		if (x == 0) {
+			if (y == 0)
+				game->check_castling.BR_left = false;
+			else if (y == 7)
+				game->check_castling.WR_left = false;
+		} else if (x == 7) {
+			if (y == 0)
+				game->check_castling.BR_right = false;
+			else if (y == 7)
+				game->check_castling.WR_right = false;
 		}
 	}
 
 	if (piece == KING) {
 		if (color == BLACK) {
-			check_castling.KBlack = false;
+			game->check_castling.KBlack = false;
 			if (startx == 4 && endx == 2) {
 				chb[0][3].occ = true;
 				chb[0][3].current = ROOK;
@@ -838,7 +589,7 @@ bool _makeMove(ch_template chb[][8], char *st_move, char *en_move, const int col
 				chb[0][7].current = NOPIECE;
 			}
 		} else {
-			check_castling.KWhite = false;
+			game->check_castling.KWhite = false;
 			if (startx == 4 && endx == 2) {
 				chb[7][3].occ = true;
 				chb[7][3].current = ROOK;
@@ -864,84 +615,74 @@ bool _makeMove(ch_template chb[][8], char *st_move, char *en_move, const int col
 	chb[starty][startx].c = EMPTY;
 	chb[starty][startx].current = NOPIECE;
 
+	key ^= zobrist_castling[_packCastling(game)];
+	if (game->enpassant)
+		key ^= zobrist_enpassant[game->enpassant_file];
+	game->key = key;
 	return true;
 }
 
-bool makeMove(ch_template chb[][8], char *st_move, char *en_move, const int color)
+void _unmakeMove(ChessGame *game, ch_template chb[][8], const MoveUndo *undo)
 {
-	if ( _makeMove(chb, st_move, en_move, color, true))
-		return true;
-	else
-		return false;
+	unsigned short startx = undo->from & 7, starty = undo->from >> 3;
+	unsigned short endx = undo->to & 7, endy = undo->to >> 3;
+	int color = chb[endy][endx].c;
+
+	chb[starty][startx].occ = true;
+	chb[starty][startx].current = chb[endy][endx].current;
+	chb[starty][startx].c = color;
+	if (undo->captured != NOPIECE) {
+		int side = BB_SIDE((color == BLACK)?WHITE:BLACK), idx = _pieceIndex(undo->captured);
+		chb[endy][endx].occ = true;
+		chb[endy][endx].current = undo->captured;
+		chb[endy][endx].c = (color == BLACK)?WHITE:BLACK;
+		game->piece_count[side][idx]++;
+		game->material[side] += piece_value[idx];
+	} else {
+		chb[endy][endx].occ = false;
+		chb[endy][endx].current = NOPIECE;
+		chb[endy][endx].c = EMPTY;
+	}
+
+	if (chb[starty][startx].current == KING && startx == 4 && (endx == 2 || endx == 6)) {
+		unsigned short row = (color == BLACK)?0:7;
+		unsigned short rook_from = (endx == 2)?0:7, rook_to = (endx == 2)?3:5;
+		chb[row][rook_from].occ = true;
+		chb[row][rook_from].current = ROOK;
+		chb[row][rook_from].c = color;
+		chb[row][rook_to].occ = false;
+		chb[row][rook_to].current = NOPIECE;
+		chb[row][rook_to].c = EMPTY;
+	}
+
+	_unpackCastling(game, undo->castling);
+	_unpackEnpassant(game, undo->enpassant);
+	game->key = undo->key;
 }
 
-void _removeThreatsToKing(ch_template chb[][8], const int color)
+bool makeMove(ChessGame *game, ch_template chb[][8], char *st_move, char *en_move, const int color)
 {
-	ch_template next_chb[8][8];
-	int ccolor = (color == BLACK)?WHITE:BLACK;
-	bool removed = false;
-	CastlingBool tempCstl = check_castling;
-
-	for (int i = 0; i < 8; i++) {
-		for (int j = 0; j < 8; j++) {
-			next_chb[i][j] = chb[i][j];
-		}
-	}
+	MoveUndo undo;
 
-	if (color == BLACK) {
-		BlackKing = safe;
-	} else {
-		WhiteKing = safe;
+	if (!_makeMove(game, chb, st_move, en_move, color, true, &undo))
+		return false;
+	if (game->history_count == HISTORY_SIZE) {
+		memmove(game->history, game->history + 1, (HISTORY_SIZE - 1)*sizeof(MoveUndo));
+		game->history_count--;
 	}
+	game->history[game->history_count++] = undo;
+	return true;
+}
 
-	for (int i = 0; i < 6; i++) {
-		MoveNode *curr = (color == WHITE)?w_moves[i]:b_moves[i];
-		while (curr) {
-			_makeMove(next_chb, curr->start, curr->end, color, false);
-			ch_template temp_chb[8][8];
-			_copyBoard(temp_chb, next_chb);
-			MoveNode **temp_moves = malloc(6*sizeof(MoveNode));
-			for (int k = 0; k < 6; k++) {
-				temp_moves[k] = NULL;
-			}
-			_fillMoveLists(next_chb, &temp_moves, ccolor);
-			MoveNode *curr_nextPlayer[6] = {temp_moves[0], temp_moves[1], temp_moves[2],
-				temp_moves[3], temp_moves[4], temp_moves[5]};
-			for (int z = 0; z < 6; z++) {
-				while (curr_nextPlayer[z]) {
-					_makeMove(next_chb, curr_nextPlayer[z]->start, curr_nextPlayer[z]->end, ccolor, false);
-					if (!_isKingOnTheBoard(next_chb, color)) {
-						_removeMove((color == WHITE)?&w_moves[i]:&b_moves[i], curr->start, curr->end);
-						removed = true;
-						if (color == WHITE)
-							white_removed_moves++;
-						else
-							black_removed_moves++;
-						break;
-					}
-					_copyBoard(next_chb, temp_chb);
-					curr_nextPlayer[z] = curr_nextPlayer[z]->nxt;
-				}
-				if (removed) {
-					removed = false;
-					break;
-				}
-			}
-			for (int k = 0; k < 8; k++) {
-				for (int l = 0; l < 8; l++) {
-					next_chb[k][l] = chb[k][l];
-				}
-				if (k < 6)
-					deleteMoveList(&temp_moves[k]);
-			}
-			free(temp_moves);
-			curr = curr->nxt;
-		}
-	}
-	check_castling = tempCstl;
+bool unmakeMove(ChessGame *game, ch_template chb[][8])
+{
+	if (!game->history_count)
+		return false;
+	_unmakeMove(game, chb, &game->history[--game->history_count]);
+	return true;
 }
 
-void playMoves(ch_template chb[][8], int *round, unsigned short move_count, ...)
+void playMoves(ChessGame *game, ch_template chb[][8], int *round, unsigned short move_count, ...)
 {
 	va_list next_move;
 	char temp[5], move_begin[3], move_end[3];
@@ -958,30 +699,9 @@ void playMoves(ch_template chb[][8], int *round, unsigned short move_count, ...)
 		move_begin[1] = temp[1];
 		move_end[0] = temp[2];
 		move_end[1] = temp[3];
-		getAllMoves(chb, (*round));
-		makeMove(chb, move_begin, move_end, (*round));
+		getAllMoves(game, chb, (*round));
+		makeMove(game, chb, move_begin, move_end, (*round));
 		*round = ((*round)== BLACK)?WHITE:BLACK;
 	}
 	va_end(next_move);
 }
-
-bool _isKingOnTheBoard(ch_template chb[][8], const int color)
-{
-	for (int i = 0; i < 8; i++) {
-		for (int j = 0; j < 8; j++) {
-			if (chb[i][j].current == KING && chb[i][j].c == color) {
-				return true;
-			}
-		}
-	}
-	return false;
-}
-
-void _copyBoard(ch_template to[][8], ch_template from[][8])
-{
-	for (int i = 0; i < 8; i++) {
-		for (int j = 0; j < 8; j++) {
-			to[i][j] = from[i][j];
-		}
-	}
-}
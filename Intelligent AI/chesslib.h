@@ -16,6 +16,7 @@ extern "C" {
 #include "stdarg.h"
 #include "string.h"
 #include "ctype.h"
+#include "stdint.h"
 
 /// @cond CHESSLIB_DLL
 #if defined(__MINGW32__) || defined(_WIN32)
@@ -102,33 +103,59 @@ extern "C" {
 
 /*! \def printWhiteMoves()
  *
- * Small macro used to print the current move list of the White player.
+ * Small macro used to print the current move list of the White player of a ChessGame.
  */
-#define printWhiteMoves() printMoves(w_moves)
+#define printWhiteMoves(game) printMoves(getMoveList(game, WHITE))
 
 /*! \def printBlackMoves()
  *
- * Small macro used to print the current move list of the Black player.
+ * Small macro used to print the current move list of the Black player of a ChessGame.
  */
-#define printBlackMoves() printMoves(b_moves)
+#define printBlackMoves(game) printMoves(getMoveList(game, BLACK))
 
 
 /*! \def printMoves()
  *
- * Macro used to print all the stored moves on a given MoveNode list.
+ * Macro used to print all the stored moves on a given array of MoveNode views.
  */
 #define printMoves(x)                                                  \
 {                                                                      \
     int move_list_piece_index = 0;                                     \
     char *piece_name[6] = {"Pawns:\n", "King:\n", "Queen:\n",          \
         "Rooks:\n", "Knights:\n", "Bishops:\n"};                       \
+    const MoveNode *move_list_views = (x);                             \
     while (move_list_piece_index < 6) {                                \
         fprintf(stdout, "%s", piece_name[move_list_piece_index]);      \
-        printMoveList(x[move_list_piece_index++], stdout);             \
+        printMoveList(&move_list_views[move_list_piece_index++], stdout); \
     }                                                                  \
 }
 
 
+/*! \def MAX_MOVES
+ *
+ * Capacity of the move buffer of each player; no chess position has more than 218 moves.
+ */
+#define MAX_MOVES 256
+
+/*! \def MOVE_FROM()
+ *
+ * Start square of a ChessMove; squares are numbered 0 (A8) to 63 (H1), row by row.
+ */
+#define MOVE_FROM(m) ((m) & 0x3f)
+
+/*! \def MOVE_TO()
+ *
+ * End square of a ChessMove.
+ */
+#define MOVE_TO(m) (((m) >> 6) & 0x3f)
+
+/*! \def MOVE_PIECE()
+ *
+ * Index of the moving piece in the arrays returned by getMoveList().
+ */
+#define MOVE_PIECE(m) (((m) >> 12) & 0x7)
+
+
 /*! \struct ch_template
  *
  * The main chessboard structure used to represent a single square, and the data
@@ -160,12 +187,11 @@ typedef struct ch_template ch_template;
 /*! \enum KingState
  *
  * The KingState enum is used to store the current state of a King on the chessboard.
- * It's used with the WhiteKing and BlackKing KingState enum globals which store the state
- * of both Kings, during a single chess match.
+ * Every ChessGame keeps the state of both Kings; getKingState() returns it.
  */
 enum KingState {
 	check,
-	/**< If a King is threatened his global KingState enum gets the check value.*/
+	/**< If a King is threatened his KingState gets the check value.*/
 
 	checkmate,
 	/**< A player's King gets the checkmate value when that player has no more moves to play.*/
@@ -180,73 +206,124 @@ typedef enum KingState KingState;
 
 
 
-/*! \struct MoveNode
+/*! \typedef ChessMove
  *
-  * MoveNode is the main node structure used to store information for move lists.
- * This structure is exposed due to the fact that the move lists of both players (Black and White)
- * are globals. The person using this library has no use for this structure.
+ * A move packed in 16 bits: the start square in bits 0-5, the end square in bits 6-11
+ * and the piece index in bits 12-14. Use MOVE_FROM(), MOVE_TO() and MOVE_PIECE() to unpack it.
  */
-struct MoveNode {
-	char start[3];
-	/**< String for the square the piece is on; e.g. "A1", "H8"*/
+typedef unsigned short ChessMove;
+
+
+
+/*! \struct MoveUndo
+ *
+ * Compact record of everything a move changes besides the moving piece itself: the captured piece,
+ * the castling rights, the en passant state and the Zobrist key from before the move. makeMove() stores one for
+ * every move played so that unmakeMove() can take it back without keeping copies of the board.
+ */
+struct MoveUndo {
+	unsigned char from;
+	/**< Start square of the move, 0 (A8) to 63 (H1).*/
+
+	unsigned char to;
+	/**< End square of the move.*/
+
+	char captured;
+	/**< Letter of the captured piece, or NOPIECE.*/
+
+	unsigned char castling;
+	/**< Castling rights before the move, one bit per rook and King.*/
 
-	char end[3];
-	/**< String for the square the piece can move to. Same format as start[3].*/
+	unsigned char enpassant;
+	/**< En passant state before the move.*/
 
-	struct MoveNode *nxt;
-	/**< Next node in the list.*/
+	uint64_t key;
+	/**< Zobrist key of the position before the move.*/
 };
 
-/*! \typedef Typedef of struct MoveNode to MoveNode.
+/*! \typedef Typedef of struct MoveUndo to MoveUndo.
  */
-typedef struct MoveNode MoveNode;
+typedef struct MoveUndo MoveUndo;
 
 
 
-/*
+/*! \struct MoveNode
  *
- *round, for both players; each index of the array refers to each piece like so:
- *0 is Pawn (P), 1 is King (K), 2 is Queen (Q), 3 is Rook (R), 4 is Knight (N), 5 is Bishop (B)*/
-MoveNode *b_moves[6];
-MoveNode *w_moves[6];
+ * MoveNode is a view over the moves of one piece type, stored contiguously in the move buffer
+ * of a player. getMoveList() returns six of them, one for each piece type.
+ */
+struct MoveNode {
+	const ChessMove *move;
+	/**< First move of this piece type in the move buffer.*/
 
-KingState BlackKing;
-/*! \var BlackKing
- *
- * Global KingState enum to get the Black King's state after each round.
- * It gets a value after every getMoveList() call.
+	unsigned short count;
+	/**< Number of moves in the view.*/
+};
+
+/*! \typedef Typedef of struct MoveNode to MoveNode.
  */
+typedef struct MoveNode MoveNode;
 
-KingState WhiteKing;
-/*!
-var WhiteKing
+
+
+/*! \struct ChessGame
  *
- * Global KingState enum to get the White King's state after each round.
- * It gets a value after every getMoveList() call.
+ * Opaque handle that owns everything a single chess match needs: the move lists of both players,
+ * the state of both Kings, the castling rights, the en passant state and the move history.
+ * Every library call takes the ChessGame it works on, so separate games never share any state
+ * and can be played from different threads at the same time.
  */
+typedef struct ChessGame ChessGame;
 
 
 /******************************************
  *function prototypes for the main library*
  ******************************************/
 
-int getAllMoves(ch_template chb[][8], int c_flag);
+ChessGame *createChessGame(void);
+
+void deleteChessGame(ChessGame *game);
+
+/*most bytes getAImove() may use for the move tree it prints when CHESSLIB_DUMP_TREE is defined;
+ *a tree that doesn't fit is cut short. The default is 64MB*/
+void setAIMemoryLimit(ChessGame *game, size_t bytes);
+
+/*threads getAImove() hands the root moves out to, 1 (the default) to search in the calling thread only;
+ *the chosen move is the same for any number of threads. Programs using it need to link with -pthread*/
+void setAIThreads(ChessGame *game, unsigned short threads);
+
+/*the move lists of one player after the last getAllMoves() call; each index of the array refers to each piece like so:
+ *0 is Pawn (P), 1 is King (K), 2 is Queen (Q), 3 is Rook (R), 4 is Knight (N), 5 is Bishop (B)*/
+const MoveNode *getMoveList(const ChessGame *game, const int color);
+
+/*state of the King of one player; it gets a value after every getAllMoves() call*/
+KingState getKingState(const ChessGame *game, const int color);
+
+/*64-bit Zobrist key of the current position of a game: the pieces, the player to move, the castling
+ *rights and the en passant state; it's kept up to date by every move played with makeMove()*/
+uint64_t getZobristKey(const ChessGame *game);
+
+int getAllMoves(ChessGame *game, ch_template chb[][8], int c_flag);
 
 int findOnMoveList(MoveNode *llt, char *tofind);
 
-bool makeMove(ch_template chb[][8], char *st_move, char *en_move, const int color);
+bool makeMove(ChessGame *game, ch_template chb[][8], char *st_move, char *en_move, const int color);
+
+bool unmakeMove(ChessGame *game, ch_template chb[][8]);
 
-void initChessboard(ch_template chb[][8]);
+void initChessboard(ChessGame *game, ch_template chb[][8]);
 
-void printMoveList(MoveNode *llt, FILE *fd);
+void printMoveList(const MoveNode *llt, FILE *fd);
 
-void deleteMoveList(MoveNode **llt);
+void deleteMoveList(MoveNode *llt);
 
-void __attribute__((destructor)) deleteMoves();
+void deleteMoves(ChessGame *game);
 
-void playMoves(ch_template chb[][8], int *round, unsigned short move_count, ...);
+void playMoves(ChessGame *game, ch_template chb[][8], int *round, unsigned short move_count, ...);
 
-char *getAImove(ch_template chb[][8], const int color, const unsigned short depth);
+/*best move of 'color' found by an alpha-beta search 'depth' plies deep, as a string like "E2E4" that the game owns
+ *until the next call; NULL if 'color' has no legal moves. Define CHESSLIB_DUMP_TREE to also print the whole move tree*/
+char *getAImove(ChessGame *game, ch_template chb[][8], const int color, const unsigned short depth);
 
 #ifdef __cplusplus
 }
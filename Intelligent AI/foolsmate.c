@@ -14,6 +14,7 @@
 
 int main(void)
 {
+	ChessGame *game = createChessGame();
 	ch_template chess_board[8][8];
 	int round = WHITE;
 	clock_t start, stop;
@@ -21,22 +22,23 @@ int main(void)
 
 	start = clock();
 
-	initChessboard(chess_board);
-	playMoves(chess_board, &round, 4, "f2f3", "e7e5", "g2g4", "d8h4");
-	getAllMoves(chess_board, round);
+	initChessboard(game, chess_board);
+	playMoves(game, chess_board, &round, 4, "f2f3", "e7e5", "g2g4", "d8h4");
+	getAllMoves(game, chess_board, round);
 
 	stop = clock();
 	total_cpu_time = ((double)(stop - start))/CLOCKS_PER_SEC;
 	printf("CPU TIME ELAPSED:%lf\n", total_cpu_time);
 	printBoard(chess_board, 'l');
 	printf("\t\t\t***WHITE MOVES***\n");
-	printWhiteMoves();
+	printWhiteMoves(game);
 	printf("\t\t\t***BLACK MOVES***\n");
-	printBlackMoves();
+	printBlackMoves(game);
 
-	if (BlackKing == checkmate)
+	if (getKingState(game, BLACK) == checkmate)
 		printf("White wins!\n");
-	if (WhiteKing == checkmate)
+	if (getKingState(game, WHITE) == checkmate)
 		printf("Black wins!\n");
+	deleteChessGame(game);
 	return 0;
 }*/
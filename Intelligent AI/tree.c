@@ -19,15 +19,17 @@ int main(void)
 	double total_time_elapsed;
 	int round = WHITE;
 
+	ChessGame *game = createChessGame();
 	ch_template chb[8][8];
-	initChessboard(chb);
+	initChessboard(game, chb);
 
-	playMoves(chb, &round, 2, "e2e4", "e7e5");//, "g1f3", "b8c6", "f1c4", "c6d4", "f3e5", "d8g5", "e5f7");
+	playMoves(game, chb, &round, 2, "e2e4", "e7e5");//, "g1f3", "b8c6", "f1c4", "c6d4", "f3e5", "d8g5", "e5f7");
 	start = clock();
-	getAImove(chb, round, TEST_DEPTH);
+	getAImove(game, chb, round, TEST_DEPTH);
 	stop = clock();
 	total_time_elapsed = ((double)(stop-start))/CLOCKS_PER_SEC;
 	printf("For depth %d ply, CPU time elapsed is %lf seconds.\n", TEST_DEPTH, total_time_elapsed);
+	deleteChessGame(game);
 	return 0;
 }*/
 
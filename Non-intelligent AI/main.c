@@ -3,10 +3,13 @@
    * BASIC PARTS:                          *
    * Some definitions                      *
    * Board representation and main varians *
+   * Bitboards and attack tables           *
+   * Zobrist keys and transposition table  *
    * Move generator                        *
    * Evaluation for current position       *
    * Make and Take back a move, IsInCheck  *
    * Search function - a typical alphabeta *
+   * Perft - move generator test           *
    * Utility                               *
    * Main program                          *
  */
@@ -14,11 +17,28 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
-
-#define TIMEALLOC (55000)
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+#ifdef __BMI2__
+#include <immintrin.h>
+#endif
+
+#define MOVES_TO_GO (30)     /* moves left to plan for when the time control
+                                 * has no move count */
+#define CHECK_NODES (1023)      /* look at the clock every 1024 nodes */
+#define DELTA_MARGIN (200)      /* a capture that can't lift the score to
+                                 * alpha by this much is not searched */
 
 typedef enum mybool {
 false = 0, true = 1} mybool;
+
+/*
+   Everything a search changes is per thread, so Lazy SMP helpers can
+   search their own copy of the board.  The main thread's copy is the game.
+ */
+#define THREAD          _Thread_local
+#define MAX_THREADS     64
 /*
    ****************************************************************************
    * Some definitions                                                         *
@@ -78,7 +98,7 @@ int             initial_piece[64] =
     ROOK, KNIGHT, BISHOP, QUEEN, KING, BISHOP, KNIGHT, ROOK
 };
 
-int             piece[64];
+THREAD int      piece[64];
 
 int             initial_color[64] =
 {
@@ -92,9 +112,9 @@ int             initial_color[64] =
     WHITE, WHITE, WHITE, WHITE, WHITE, WHITE, WHITE, WHITE
 };
 
-int             color[64];
+THREAD int      color[64];
 
-int             side;           /* side to move, value = BLACK or WHITE */
+THREAD int      side;           /* side to move, value = BLACK or WHITE */
 
 /* For move generation */
 #define MOVE_TYPE_NONE                  0
@@ -112,19 +132,471 @@ typedef struct tag_MOVE {
                     dest,
                     type;
 }               MOVE;
+/* Material and piece-square score of each side, see Eval() */
+typedef struct tag_EVALSUM {
+    int             material[2];
+    int             pst[2];
+}               EVALSUM;
+
+THREAD EVALSUM  eval_sum;       /* of the current position, MakeMove keeps it up to date */
+
 /* For storing all moves of game */
 typedef struct tag_HIST {
     MOVE            m;
     int             cap;
+    uint64_t        hash;       /* hash_key before the move */
+    uint64_t        pawn_hash;  /* pawn_key before the move */
+    EVALSUM         sum;        /* eval_sum before the move */
 }               HIST;
 
-HIST            hist[6000];     /* Game length < 6000 */
+THREAD HIST     hist[6000];     /* Game length < 6000 */
 
-int             hdp;            /* Current move order */
+THREAD int      hdp;            /* Current move order */
 
 /* For searching */
-int             nodes;          /* Count all visited nodes when searching */
-int             ply;            /* ply of search */
+THREAD int      nodes;          /* Count all visited nodes when searching */
+THREAD int      ply;            /* ply of search */
+int             threads = 1;    /* search threads, set by the xboard cores command */
+int             stop_search;    /* tells the searching threads to return */
+int             time_soft;      /* ms after which no new iteration starts, 0 = no limit */
+int             time_hard;      /* ms after which the search is stopped, 0 = no limit */
+THREAD int64_t  deadline;       /* clock time at which Search() stops, 0 = never */
+
+/* relaxed atomics for the data the search threads share */
+#define ATOMIC_LOAD(x)      __atomic_load_n(&(x), __ATOMIC_RELAXED)
+#define ATOMIC_STORE(x, v)  __atomic_store_n(&(x), (v), __ATOMIC_RELAXED)
+
+/*
+   ****************************************************************************
+   * Bitboards and attack tables                                              *
+   ****************************************************************************
+ */
+/*
+   Bit n of a bitboard is square n of piece[]/color[], so bit 0 is a8 and
+   bit 63 is h1.  Sliding attacks are looked up in tables indexed by the
+   occupancy of the relevant squares: with a multiply-and-shift "magic",
+   or with PEXT when compiled for BMI2.
+ */
+typedef uint64_t BITBOARD;
+
+#define BIT(pos) (((BITBOARD)1) << (pos))
+#define LSB(bb) (__builtin_ctzll(bb))
+#define POPCOUNT(bb) (__builtin_popcountll(bb))
+
+typedef struct tag_MAGIC {
+    BITBOARD        mask;       /* relevant occupancy, board edges excluded */
+    BITBOARD        magic;
+    BITBOARD       *attacks;    /* 1 << POPCOUNT(mask) entries */
+    int             shift;      /* 64 - POPCOUNT(mask) */
+}               MAGIC;
+
+#ifdef __BMI2__
+#define MAGIC_INDEX(m, occ) (_pext_u64((occ), (m)->mask))
+#else
+#define MAGIC_INDEX(m, occ) (((((occ) & (m)->mask) * (m)->magic)) >> (m)->shift)
+#endif
+
+MAGIC           rook_magic[64];
+MAGIC           bishop_magic[64];
+BITBOARD        rook_table[0x19000];    /* sum of 1 << POPCOUNT(mask) */
+BITBOARD        bishop_table[0x1480];
+BITBOARD        knight_attacks[64];
+BITBOARD        king_attacks[64];
+BITBOARD        pawn_attacks[2][64];    /* squares attacked by a pawn of that color */
+
+BITBOARD        file_mask[8];
+BITBOARD        adjacent_files[8];      /* the files next to a file */
+BITBOARD        passed_mask[2][64];     /* squares ahead of a pawn of that color, on
+                                         * its file and the files next to it */
+
+THREAD BITBOARD bb_color[2];    /* all pieces of one color */
+THREAD BITBOARD bb_piece[6];    /* all pieces of one type, both colors */
+
+int             PopLsb(BITBOARD * bb)
+{
+    int             pos = LSB(*bb);
+    *bb &= *bb - 1;
+    return pos;
+}
+
+/* Slow attack generator, only used to fill the tables */
+BITBOARD        SlideAttacks(int pos, BITBOARD occupied, const int *drow, const int *dcol, mybool edges)
+{
+    BITBOARD        attacks = 0;
+    int             d,
+                    row,
+                    col;
+    for (d = 0; d < 4; d++) {
+        for (row = (int) ROW(pos) + drow[d], col = COL(pos) + dcol[d];
+             row >= 0 && row < 8 && col >= 0 && col < 8;
+             row += drow[d], col += dcol[d]) {
+            if (!edges && (row + drow[d] < 0 || row + drow[d] > 7 || col + dcol[d] < 0 || col + dcol[d] > 7))
+                break;
+            attacks |= BIT(row * 8 + col);
+            if (occupied & BIT(row * 8 + col))
+                break;
+        }
+    }
+    return attacks;
+}
+
+/* Magic numbers for this square numbering (a8 == 0), found by trying
+   sparse random numbers until the whole table of a square is collision free */
+const BITBOARD  rook_magics[64] =
+{
+    0x1080004008801020ULL, 0x0840092002C03000ULL, 0x1900200010400900ULL,
+    0x0880100008000480ULL, 0x4200100420080200ULL, 0x8100020100080400ULL,
+    0x0200040110886200ULL, 0x0200008040220411ULL, 0x0404800084400220ULL,
+    0x0000401000402000ULL, 0x0086001081220440ULL, 0x0408800800100280ULL,
+    0x000A001201040820ULL, 0x8848800200840080ULL, 0x4001000100040200ULL,
+    0x0442000102105084ULL, 0x9080010020804100ULL, 0x0040404000201009ULL,
+    0x0000808010002009ULL, 0x2200090021D00100ULL, 0x0008008008040080ULL,
+    0x0004004002010040ULL, 0x0011040008015042ULL, 0x00000A0001768104ULL,
+    0x0000800080204009ULL, 0x2010004140002001ULL, 0x9800200280100080ULL,
+    0x1000100080080080ULL, 0x0050500500080100ULL, 0x0000020080040080ULL,
+    0x0C10010400420810ULL, 0x1040008200005104ULL, 0x01808240088004A0ULL,
+    0x0882804004802000ULL, 0x0880402001001100ULL, 0x2000210409001000ULL,
+    0x2000480131001500ULL, 0x0000800400800200ULL, 0x000002380C001003ULL,
+    0x4600084882000431ULL, 0x0080002000504000ULL, 0x0300500020004002ULL,
+    0x0040408200220011ULL, 0x0010040008004040ULL, 0x0000080004008080ULL,
+    0x0010040002008080ULL, 0x2012004881020004ULL, 0x8300842444820011ULL,
+    0x0088403882010200ULL, 0x0820400080210100ULL, 0x0110910040A00300ULL,
+    0x0801100280080480ULL, 0x0242009008200600ULL, 0x1002000489500200ULL,
+    0x0040800200010080ULL, 0x0091800041000080ULL, 0x0000209300488001ULL,
+    0x04C1002414824001ULL, 0x020020000B001041ULL, 0x7000100004200901ULL,
+    0x8002002004100802ULL, 0x30010002084C0007ULL, 0x0888221800813004ULL,
+    0x4000002840840112ULL
+};
+
+const BITBOARD  bishop_magics[64] =
+{
+    0x20C0090901061081ULL, 0x0024040094030104ULL, 0x8210810200290200ULL,
+    0x0011040484620000ULL, 0x0081104002221000ULL, 0x0009012011001350ULL,
+    0x0081010802400380ULL, 0x0000420210010408ULL, 0x0008105002280050ULL,
+    0x0001028484040044ULL, 0x2A00880810408804ULL, 0x7020022282000100ULL,
+    0x0084040420100A50ULL, 0x000401010840E000ULL, 0x2020020210420888ULL,
+    0x0008084202012010ULL, 0x2010400810018800ULL, 0x0445122008020840ULL,
+    0x0804100808002008ULL, 0x0008002104110100ULL, 0x0061005820080800ULL,
+    0x2001000200820100ULL, 0x480C210084010800ULL, 0x3004442500480420ULL,
+    0x1010102240048100ULL, 0x00182009084220A3ULL, 0x8803090A10004205ULL,
+    0x0208080040202020ULL, 0x000C044084010040ULL, 0x00A1010002004106ULL,
+    0x6008210020640202ULL, 0x1600902112860801ULL, 0x00042008C1220200ULL,
+    0x010C042002440140ULL, 0x5022080200040820ULL, 0x0402004042940100ULL,
+    0x0860108400008020ULL, 0x000C080022021000ULL, 0x0264080652822100ULL,
+    0x4005031221010401ULL, 0x0004502410008400ULL, 0x000500B010A20400ULL,
+    0x0415094050080800ULL, 0x080000201800A104ULL, 0x4022A80304000110ULL,
+    0x4012140802028020ULL, 0x40200104010100A0ULL, 0x12810806008B0C41ULL,
+    0x0020441008080000ULL, 0x2002120084045420ULL, 0x0704020062080002ULL,
+    0x0000001084040001ULL, 0x0322200891240200ULL, 0xF040200210024800ULL,
+    0x0140824832008042ULL, 0x000210020A004602ULL, 0x0083042805141020ULL,
+    0x002C12009A011000ULL, 0x0041A00044140400ULL, 0x00004004020A0202ULL,
+    0x0000140010020210ULL, 0x2864160811012200ULL, 0x2060080841082A17ULL,
+    0xA010041108003100ULL
+};
+
+/* Fill the attack table of one slider on one square. Returns the table size. */
+int             InitMagic(MAGIC * m, int pos, BITBOARD magic, BITBOARD * table, const int *drow, const int *dcol)
+{
+    BITBOARD        sub;
+    int             size = 0;
+
+    m->mask = SlideAttacks(pos, 0, drow, dcol, false);
+    m->shift = 64 - POPCOUNT(m->mask);
+    m->magic = magic;
+    m->attacks = table;
+    sub = 0;
+    do {                        /* all subsets of the mask */
+        assert(table[MAGIC_INDEX(m, sub)] == 0
+               || table[MAGIC_INDEX(m, sub)] == SlideAttacks(pos, sub, drow, dcol, true));
+        table[MAGIC_INDEX(m, sub)] = SlideAttacks(pos, sub, drow, dcol, true);
+        size++;
+        sub = (sub - m->mask) & m->mask;
+    } while (sub);
+    return size;
+}
+
+void            InitAttacks(void)
+{
+    static const int rook_drow[4] = {-1, 1, 0, 0},
+                    rook_dcol[4] = {0, 0, -1, 1},
+                    bishop_drow[4] = {-1, -1, 1, 1},
+                    bishop_dcol[4] = {-1, 1, -1, 1},
+                    knight_drow[8] = {-2, -2, -1, -1, 1, 1, 2, 2},
+                    knight_dcol[8] = {-1, 1, -2, 2, -2, 2, -1, 1};
+    int             i,
+                    d,
+                    row,
+                    col,
+                    rook_size = 0,
+                    bishop_size = 0;
+
+    for (i = 0; i < 64; i++) {
+        for (d = 0; d < 8; d++) {
+            row = ROW(i) + knight_drow[d];
+            col = COL(i) + knight_dcol[d];
+            if (row >= 0 && row < 8 && col >= 0 && col < 8)
+                knight_attacks[i] |= BIT(row * 8 + col);
+        }
+        for (row = (int) ROW(i) - 1; row <= (int) ROW(i) + 1; row++)
+            for (col = COL(i) - 1; col <= COL(i) + 1; col++)
+                if (row >= 0 && row < 8 && col >= 0 && col < 8 && row * 8 + col != i)
+                    king_attacks[i] |= BIT(row * 8 + col);
+        if (ROW(i) > 0) {
+            if (COL(i) > 0)
+                pawn_attacks[WHITE][i] |= BIT(i - 9);
+            if (COL(i) < 7)
+                pawn_attacks[WHITE][i] |= BIT(i - 7);
+        }
+        if (ROW(i) < 7) {
+            if (COL(i) > 0)
+                pawn_attacks[BLACK][i] |= BIT(i + 7);
+            if (COL(i) < 7)
+                pawn_attacks[BLACK][i] |= BIT(i + 9);
+        }
+        file_mask[COL(i)] |= BIT(i);
+        rook_size += InitMagic(&rook_magic[i], i, rook_magics[i], rook_table + rook_size, rook_drow, rook_dcol);
+        bishop_size += InitMagic(&bishop_magic[i], i, bishop_magics[i], bishop_table + bishop_size, bishop_drow, bishop_dcol);
+    }
+    for (i = 0; i < 8; i++)
+        adjacent_files[i] = (i > 0 ? file_mask[i - 1] : 0) | (i < 7 ? file_mask[i + 1] : 0);
+    for (i = 0; i < 64; i++)
+        for (d = 0; d < 64; d++)
+            if ((file_mask[COL(i)] | adjacent_files[COL(i)]) & BIT(d)) {
+                if (ROW(d) < ROW(i))
+                    passed_mask[WHITE][i] |= BIT(d);
+                else if (ROW(d) > ROW(i))
+                    passed_mask[BLACK][i] |= BIT(d);
+            }
+    assert(rook_size == sizeof rook_table / sizeof rook_table[0]);
+    assert(bishop_size == sizeof bishop_table / sizeof bishop_table[0]);
+}
+
+#define ROOK_ATTACKS(pos, occ) (rook_magic[pos].attacks[MAGIC_INDEX(&rook_magic[pos], occ)])
+#define BISHOP_ATTACKS(pos, occ) (bishop_magic[pos].attacks[MAGIC_INDEX(&bishop_magic[pos], occ)])
+
+/* All pieces of both colors attacking square pos */
+BITBOARD        AttacksTo(int pos, BITBOARD occupied)
+{
+    return (pawn_attacks[BLACK][pos] & bb_piece[PAWN] & bb_color[WHITE])
+        | (pawn_attacks[WHITE][pos] & bb_piece[PAWN] & bb_color[BLACK])
+        | (knight_attacks[pos] & bb_piece[KNIGHT])
+        | (king_attacks[pos] & bb_piece[KING])
+        | (ROOK_ATTACKS(pos, occupied) & (bb_piece[ROOK] | bb_piece[QUEEN]))
+        | (BISHOP_ATTACKS(pos, occupied) & (bb_piece[BISHOP] | bb_piece[QUEEN]));
+}
+
+/* Rebuild the bitboards from piece[] and color[] */
+void            InitBitboards(void)
+{
+    int             i;
+    memset(bb_color, 0, sizeof bb_color);
+    memset(bb_piece, 0, sizeof bb_piece);
+    for (i = 0; i < 64; i++)
+        if (color[i] != EMPTY) {
+            bb_color[color[i]] |= BIT(i);
+            bb_piece[piece[i]] |= BIT(i);
+        }
+}
+
+/*
+   ****************************************************************************
+   * Zobrist keys and transposition table                                     *
+   ****************************************************************************
+ */
+/*
+   The table is an array of buckets of four 16 byte entries, so one bucket
+   fills one 64 byte cache line and a probe only ever touches that line.
+   A position goes to the bucket picked by the low bits of its key.
+
+   The search threads share the table without locks: an entry keeps its
+   key xor-ed with its data, so an entry torn by two threads writing it at
+   once no longer matches any key and is simply never found.
+ */
+#define HASH_EXACT      1       /* score is exact */
+#define HASH_LOWER      2       /* search failed high, score is a lower bound */
+#define HASH_UPPER      3       /* search failed low, score is an upper bound */
+#define HASH_BUCKET     4       /* entries per bucket */
+#define HASH_DEFAULT_MB 16
+
+typedef union tag_HASHDATA {
+    struct {
+        int16_t         score;
+        uint16_t        move;   /* from | dest << 6 | type << 12 */
+        uint8_t         depth;
+        uint8_t         bound;
+        uint8_t         age;    /* hash_age of the search that stored it */
+        uint8_t         pad;
+    };
+    uint64_t        word;
+}               HASHDATA;
+
+typedef struct tag_HASHE {
+    uint64_t        lock;       /* key ^ data.word */
+    HASHDATA        data;
+}               HASHE;
+
+typedef struct tag_HASHBUCKET {
+    HASHE           entry[HASH_BUCKET];
+}               __attribute__((aligned(64))) HASHBUCKET;
+
+#define PACK_MOVE(m) ((uint16_t) ((m).from | (m).dest << 6 | (m).type << 12))
+
+BITBOARD        zobrist_piece[2][6][64];
+BITBOARD        zobrist_side;   /* xor-ed in when black is to move */
+THREAD BITBOARD hash_key;       /* key of the current position */
+THREAD BITBOARD pawn_key;       /* key of the pawns alone, for the pawn hash table */
+
+HASHBUCKET     *hash_table = NULL;
+uint64_t        hash_mask;      /* number of buckets - 1 */
+uint8_t         hash_age;
+
+/* xorshift64*, fixed seed so every run gets the same keys */
+BITBOARD        Rand64(void)
+{
+    static BITBOARD seed = 0x9e3779b97f4a7c15ULL;
+    seed ^= seed >> 12;
+    seed ^= seed << 25;
+    seed ^= seed >> 27;
+    return seed * 0x2545f4914f6cdd1dULL;
+}
+
+void            InitZobrist(void)
+{
+    int             c,
+                    p,
+                    pos;
+    for (c = 0; c < 2; c++)
+        for (p = 0; p < 6; p++)
+            for (pos = 0; pos < 64; pos++)
+                zobrist_piece[c][p][pos] = Rand64();
+    zobrist_side = Rand64();
+}
+
+/* Key of the current position from scratch; MakeMove keeps it up to date */
+BITBOARD        ComputeHash(void)
+{
+    int             i;
+    BITBOARD        key = 0;
+    for (i = 0; i < 64; i++)
+        if (color[i] != EMPTY)
+            key ^= zobrist_piece[color[i]][piece[i]][i];
+    if (side == BLACK)
+        key ^= zobrist_side;
+    return key;
+}
+
+/* Key of the pawns from scratch, made of the same keys as hash_key */
+BITBOARD        ComputePawnHash(void)
+{
+    BITBOARD        key = 0,
+                    pawns;
+    int             pos;
+    for (pawns = bb_piece[PAWN]; pawns;) {
+        pos = PopLsb(&pawns);
+        key ^= zobrist_piece[color[pos]][PAWN][pos];
+    }
+    return key;
+}
+
+/*
+   Resize the table to the largest power of two buckets that fits in mb.
+   A size below 1 MB is refused and the old table kept.
+ */
+int             SetHashSize(int mb)
+{
+    uint64_t        buckets = 1;
+    HASHBUCKET     *table;
+    if (mb < 1)
+        return 0;
+    while (buckets < SIZE_MAX / (4 * sizeof(HASHBUCKET))
+           && buckets * 2 * sizeof(HASHBUCKET) <= (uint64_t) mb * 1024 * 1024)
+        buckets *= 2;
+    if (posix_memalign((void **) &table, sizeof(HASHBUCKET), buckets * sizeof(HASHBUCKET)))
+        return 0;
+    free(hash_table);
+    hash_table = table;
+    hash_mask = buckets - 1;
+    memset(hash_table, 0, buckets * sizeof(HASHBUCKET));
+    return 1;
+}
+
+/* Copy the entry of the current position to *d, return 0 if there is none */
+int             ProbeHash(HASHDATA * d)
+{
+    HASHE          *e = hash_table[hash_key & hash_mask].entry;
+    int             i;
+    for (i = 0; i < HASH_BUCKET; i++) {
+        d->word = ATOMIC_LOAD(e[i].data.word);
+        if ((ATOMIC_LOAD(e[i].lock) ^ d->word) == hash_key && d->bound)
+            return 1;
+    }
+    return 0;
+}
+
+/*
+   Replace the entry of the same position if there is one, else the
+   entry left by an older search, else the shallowest one.  A store
+   without a best move keeps the move already known for the position.
+ */
+void            StoreHash(int depth, int bound, int score, MOVE m)
+{
+    HASHE          *e = hash_table[hash_key & hash_mask].entry;
+    HASHDATA        d,
+                    old,
+                    victim;
+    int             i,
+                    v = 0,
+                    same = 0;
+    victim.word = ATOMIC_LOAD(e[0].data.word);
+    for (i = 0; i < HASH_BUCKET; i++) {
+        old.word = ATOMIC_LOAD(e[i].data.word);
+        if ((ATOMIC_LOAD(e[i].lock) ^ old.word) == hash_key) {
+            v = i;
+            victim = old;
+            same = 1;
+            break;
+        }
+        if ((victim.age == hash_age && old.age != hash_age)
+            || ((victim.age == hash_age) == (old.age == hash_age)
+                && old.depth < victim.depth)) {
+            v = i;
+            victim = old;
+        }
+    }
+    d.word = 0;
+    if (m.type != MOVE_TYPE_NONE)
+        d.move = PACK_MOVE(m);
+    else if (same)
+        d.move = victim.move;
+    d.score = score;
+    d.depth = depth;
+    d.bound = bound;
+    d.age = hash_age;
+    ATOMIC_STORE(e[v].lock, hash_key ^ d.word);
+    ATOMIC_STORE(e[v].data.word, d.word);
+}
+
+/*
+   Mate scores count plies from the root; in the table they count plies
+   from the stored position, so they stay right wherever it is found.
+ */
+int             ScoreToHash(int score)
+{
+    if (score > MATE - 1000)
+        return score + ply;
+    if (score < -MATE + 1000)
+        return score - ply;
+    return score;
+}
+
+int             ScoreFromHash(int score)
+{
+    if (score > MATE - 1000)
+        return score - ply;
+    if (score < -MATE + 1000)
+        return score + ply;
+    return score;
+}
 
 /*
    ****************************************************************************
@@ -160,163 +632,128 @@ void            Gen_PushPawn(int from, int dest, MOVE * pBuf, int *pMCount)
     }
 }
 
-/* Gen all moves of current_side to move and push them to pBuf, return number of moves */
-int             Gen(int current_side, MOVE * pBuf)
+/* Squares a piece other than a pawn on pos attacks */
+BITBOARD        PieceAttacks(int pos, BITBOARD occupied)
 {
-    int             i,
-                    k,
-                    y,
-                    row,
-                    col,
-                    movecount;
-    movecount = 0;
+    switch (piece[pos]) {
+    case KNIGHT:
+        return knight_attacks[pos];
 
-    for (i = 0; i < 64; i++)    /* Scan all board */
-        if (color[i] == current_side) {
-            switch (piece[i]) {
-            case PAWN:
-                col = COL(i);
-                row = ROW(i);
-                if (current_side == BLACK) {
-                    if (color[i + ONE_RANK] == EMPTY)
-                        Gen_PushPawn(i, i + ONE_RANK, pBuf, &movecount);
-                    if (row == 1 && color[i + ONE_RANK] == EMPTY && color[i + TWO_RANKS] == EMPTY)
-                        Gen_PushNormal(i, i + TWO_RANKS, pBuf, &movecount);
-                    if (col && color[i + 7] == WHITE)
-                        Gen_PushNormal(i, i + 7, pBuf, &movecount);
-                    if (col < 7 && color[i + 9] == WHITE)
-                        Gen_PushNormal(i, i + 9, pBuf, &movecount);
-                } else {
-                    if (color[i - ONE_RANK] == EMPTY)
-                        Gen_PushPawn(i, i - ONE_RANK, pBuf, &movecount);
-                    if (row == 6 && color[i - ONE_RANK] == EMPTY && color[i - TWO_RANKS] == EMPTY)
-                        Gen_PushNormal(i, i - TWO_RANKS, pBuf, &movecount);
-                    if (col && color[i - 9] == BLACK)
-                        Gen_PushNormal(i, i - 9, pBuf, &movecount);
-                    if (col < 7 && color[i - 7] == BLACK)
-                        Gen_PushNormal(i, i - 7, pBuf, &movecount);
-                }
-                break;
+    case BISHOP:
+        return BISHOP_ATTACKS(pos, occupied);
 
-            case QUEEN:         /* == BISHOP+ROOK */
-            case BISHOP:
-                for (y = i - 9; y >= 0 && COL(y) != 7; y -= 9) {        /* go left up */
-                    if (color[y] != current_side)
-                        Gen_PushNormal(i, y, pBuf, &movecount);
-                    if (color[y] != EMPTY)
-                        break;
-
-                }
-                for (y = i - 7; y >= 0 && COL(y) != 0; y -= 7) {        /* go right up */
-                    if (color[y] != current_side)
-                        Gen_PushNormal(i, y, pBuf, &movecount);
-                    if (color[y] != EMPTY)
-                        break;
+    case ROOK:
+        return ROOK_ATTACKS(pos, occupied);
 
-                }
-                for (y = i + 9; y < 64 && COL(y) != 0; y += 9) {        /* go right down */
-                    if (color[y] != current_side)
-                        Gen_PushNormal(i, y, pBuf, &movecount);
-                    if (color[y] != EMPTY)
-                        break;
+    case QUEEN:                 /* == BISHOP+ROOK */
+        return BISHOP_ATTACKS(pos, occupied) | ROOK_ATTACKS(pos, occupied);
 
-                }
-                for (y = i + 7; y < 64 && COL(y) != 7; y += 7) {        /* go right down */
-                    if (color[y] != current_side)
-                        Gen_PushNormal(i, y, pBuf, &movecount);
-                    if (color[y] != EMPTY)
-                        break;
+    case KING:
+        return king_attacks[pos];
 
-                }
-                if (piece[i] == BISHOP)
-                    break;
-
-                /* FALL THROUGH FOR QUEEN {I meant to do that!} ;-) */
-            case ROOK:
-                col = COL(i);
-                for (k = i - col, y = i - 1; y >= k; y--) {     /* go left */
-                    if (color[y] != current_side)
-                        Gen_PushNormal(i, y, pBuf, &movecount);
-                    if (color[y] != EMPTY)
-                        break;
+    default:
+        puts("piece type unknown");
+        assert(false);
+        return 0;
+    }
+}
 
-                }
-                for (k = i - col + 7, y = i + 1; y <= k; y++) { /* go right */
-                    if (color[y] != current_side)
-                        Gen_PushNormal(i, y, pBuf, &movecount);
-                    if (color[y] != EMPTY)
-                        break;
+/* what GenMoves() generates */
+#define GEN_ALL         0
+#define GEN_CAPTURES    1       /* captures and promotions */
+#define GEN_QUIETS      2       /* all the other moves */
 
-                }
-                for (y = i - 8; y >= 0; y -= 8) {       /* go up */
-                    if (color[y] != current_side)
-                        Gen_PushNormal(i, y, pBuf, &movecount);
-                    if (color[y] != EMPTY)
-                        break;
+/*
+   Gen the moves of the given kind for current_side to move and push them
+   to pBuf, return number of moves.  Captures and quiets together are
+   exactly all the moves.
+ */
+int             GenMoves(int current_side, MOVE * pBuf, int kind)
+{
+    int             i,
+                    movecount,
+                    promote;
+    BITBOARD        pieces,
+                    targets,
+                    occupied,
+                    mask;
+    movecount = 0;
+    occupied = bb_color[WHITE] | bb_color[BLACK];
+    /* squares pieces other than pawns may go to */
+    if (kind == GEN_CAPTURES)
+        mask = bb_color[(WHITE + BLACK) - current_side];
+    else if (kind == GEN_QUIETS)
+        mask = ~occupied;
+    else
+        mask = ~bb_color[current_side];
+
+    for (pieces = bb_color[current_side]; pieces;) {    /* Scan own pieces */
+        i = PopLsb(&pieces);
+        if (piece[i] == PAWN) {
+            promote = ROW(i) == (current_side == BLACK ? 6 : 1);
+            if (current_side == BLACK) {
+                if (color[i + ONE_RANK] == EMPTY && (kind == GEN_ALL || (kind == GEN_CAPTURES) == promote))
+                    Gen_PushPawn(i, i + ONE_RANK, pBuf, &movecount);
+                if (ROW(i) == 1 && kind != GEN_CAPTURES && color[i + ONE_RANK] == EMPTY && color[i + TWO_RANKS] == EMPTY)
+                    Gen_PushNormal(i, i + TWO_RANKS, pBuf, &movecount);
+            } else {
+                if (color[i - ONE_RANK] == EMPTY && (kind == GEN_ALL || (kind == GEN_CAPTURES) == promote))
+                    Gen_PushPawn(i, i - ONE_RANK, pBuf, &movecount);
+                if (ROW(i) == 6 && kind != GEN_CAPTURES && color[i - ONE_RANK] == EMPTY && color[i - TWO_RANKS] == EMPTY)
+                    Gen_PushNormal(i, i - TWO_RANKS, pBuf, &movecount);
+            }
+            /* captures may promote too */
+            if (kind != GEN_QUIETS)
+                for (targets = pawn_attacks[current_side][i] & bb_color[(WHITE + BLACK) - current_side]; targets;)
+                    Gen_PushPawn(i, PopLsb(&targets), pBuf, &movecount);
+            continue;
+        }
+        for (targets = PieceAttacks(i, occupied) & mask; targets;)
+            Gen_PushNormal(i, PopLsb(&targets), pBuf, &movecount);
+    }
+    return movecount;
+}
 
-                }
-                for (y = i + 8; y < 64; y += 8) {       /* go down */
-                    if (color[y] != current_side)
-                        Gen_PushNormal(i, y, pBuf, &movecount);
-                    if (color[y] != EMPTY)
-                        break;
+int             Gen(int current_side, MOVE * pBuf)
+{
+    return GenMoves(current_side, pBuf, GEN_ALL);
+}
 
-                }
-                break;
+int             GenCaptures(int current_side, MOVE * pBuf)
+{
+    return GenMoves(current_side, pBuf, GEN_CAPTURES);
+}
 
-            case KNIGHT:
-                col = COL(i);
-                y = i - 6;
-                if (y >= 0 && col < 6 && color[y] != current_side)
-                    Gen_PushNormal(i, y, pBuf, &movecount);
-                y = i - 10;
-                if (y >= 0 && col > 1 && color[y] != current_side)
-                    Gen_PushNormal(i, y, pBuf, &movecount);
-                y = i - 15;
-                if (y >= 0 && col < 7 && color[y] != current_side)
-                    Gen_PushNormal(i, y, pBuf, &movecount);
-                y = i - 17;
-                if (y >= 0 && col > 0 && color[y] != current_side)
-                    Gen_PushNormal(i, y, pBuf, &movecount);
-                y = i + 6;
-                if (y < 64 && col > 1 && color[y] != current_side)
-                    Gen_PushNormal(i, y, pBuf, &movecount);
-                y = i + 10;
-                if (y < 64 && col < 6 && color[y] != current_side)
-                    Gen_PushNormal(i, y, pBuf, &movecount);
-                y = i + 15;
-                if (y < 64 && col > 0 && color[y] != current_side)
-                    Gen_PushNormal(i, y, pBuf, &movecount);
-                y = i + 17;
-                if (y < 64 && col < 7 && color[y] != current_side)
-                    Gen_PushNormal(i, y, pBuf, &movecount);
-                break;
+int             GenQuiets(int current_side, MOVE * pBuf)
+{
+    return GenMoves(current_side, pBuf, GEN_QUIETS);
+}
 
-            case KING:
-                col = COL(i);
-                if (col && color[i - 1] != current_side)
-                    Gen_PushNormal(i, i - 1, pBuf, &movecount); /* left */
-                if (col < 7 && color[i + 1] != current_side)
-                    Gen_PushNormal(i, i + 1, pBuf, &movecount); /* right */
-                if (i > 7 && color[i - 8] != current_side)
-                    Gen_PushNormal(i, i - 8, pBuf, &movecount); /* up */
-                if (i < 56 && color[i + 8] != current_side)
-                    Gen_PushNormal(i, i + 8, pBuf, &movecount); /* down */
-                if (col && i > 7 && color[i - 9] != current_side)
-                    Gen_PushNormal(i, i - 9, pBuf, &movecount); /* left up */
-                if (col < 7 && i > 7 && color[i - 7] != current_side)
-                    Gen_PushNormal(i, i - 7, pBuf, &movecount); /* right up */
-                if (col && i < 56 && color[i + 7] != current_side)
-                    Gen_PushNormal(i, i + 7, pBuf, &movecount); /* left down */
-                if (col < 7 && i < 56 && color[i + 9] != current_side)
-                    Gen_PushNormal(i, i + 9, pBuf, &movecount); /* right down */
-                break;
-            default:
-                puts("piece type unknown");
-                assert(false);
-            }
-        }
-    return movecount;
+/*
+   True if Gen() would generate m for the side to move.  Moves from the
+   hash table and killer moves are checked with this before they are
+   played, as they were found in some other position.
+ */
+mybool          IsPseudoLegal(MOVE m)
+{
+    int             step = side == BLACK ? ONE_RANK : -ONE_RANK;
+    mybool          promote = m.type >= MOVE_TYPE_PROMOTION_TO_QUEEN;
+
+    if (color[m.from] != side || color[m.dest] == side)
+        return false;
+    if (piece[m.from] != PAWN)
+        return m.type == MOVE_TYPE_NORMAL
+            && (PieceAttacks(m.from, bb_color[WHITE] | bb_color[BLACK]) & BIT(m.dest)) != 0;
+    if (m.type != MOVE_TYPE_NORMAL && !promote)
+        return false;
+    if ((ROW(m.dest) == 0 || ROW(m.dest) == 7) != promote)
+        return false;
+    if (color[m.dest] != EMPTY)
+        return (pawn_attacks[side][m.from] & BIT(m.dest)) != 0;
+    if (m.dest == m.from + step)
+        return true;
+    return m.dest == m.from + 2 * step && ROW(m.from) == (side == BLACK ? 1 : 6)
+        && color[m.from + step] == EMPTY;
 }
 
 /*
@@ -325,18 +762,152 @@ int             Gen(int current_side, MOVE * pBuf)
                                                  *
    ****************************************************************************
  */
-int             Eval()
+int             value_piece[7] =
+{VALUE_PAWN, VALUE_KNIGHT, VALUE_BISHOP, VALUE_ROOK, VALUE_QUEEN, VALUE_KING, 0};
+
+/*
+   Piece-square tables, as seen by white with a8 first; black looks its
+   squares up mirrored.  Pieces go to the center, pawns forward, the King
+   stays behind its pawns.
+ */
+const int       pst_table[6][64] =
 {
-    int             value_piece[6] =
-    {VALUE_PAWN, VALUE_KNIGHT, VALUE_BISHOP, VALUE_ROOK, VALUE_QUEEN, VALUE_KING};
-    int             i,
-                    score = 0;
-    for (i = 0; i < 64; i++) {
-        if (color[i] == WHITE)
-            score += value_piece[piece[i]];
-        else if (color[i] == BLACK)
-            score -= value_piece[piece[i]];
+    {                           /* PAWN */
+        0, 0, 0, 0, 0, 0, 0, 0,
+        50, 50, 50, 50, 50, 50, 50, 50,
+        10, 10, 20, 30, 30, 20, 10, 10,
+        5, 5, 10, 25, 25, 10, 5, 5,
+        0, 0, 0, 20, 20, 0, 0, 0,
+        5, -5, -10, 0, 0, -10, -5, 5,
+        5, 10, 10, -20, -20, 10, 10, 5,
+        0, 0, 0, 0, 0, 0, 0, 0
+    },
+    {                           /* KNIGHT */
+        -50, -40, -30, -30, -30, -30, -40, -50,
+        -40, -20, 0, 0, 0, 0, -20, -40,
+        -30, 0, 10, 15, 15, 10, 0, -30,
+        -30, 5, 15, 20, 20, 15, 5, -30,
+        -30, 0, 15, 20, 20, 15, 0, -30,
+        -30, 5, 10, 15, 15, 10, 5, -30,
+        -40, -20, 0, 5, 5, 0, -20, -40,
+        -50, -40, -30, -30, -30, -30, -40, -50
+    },
+    {                           /* BISHOP */
+        -20, -10, -10, -10, -10, -10, -10, -20,
+        -10, 0, 0, 0, 0, 0, 0, -10,
+        -10, 0, 5, 10, 10, 5, 0, -10,
+        -10, 5, 5, 10, 10, 5, 5, -10,
+        -10, 0, 10, 10, 10, 10, 0, -10,
+        -10, 10, 10, 10, 10, 10, 10, -10,
+        -10, 5, 0, 0, 0, 0, 5, -10,
+        -20, -10, -10, -10, -10, -10, -10, -20
+    },
+    {                           /* ROOK */
+        0, 0, 0, 0, 0, 0, 0, 0,
+        5, 10, 10, 10, 10, 10, 10, 5,
+        -5, 0, 0, 0, 0, 0, 0, -5,
+        -5, 0, 0, 0, 0, 0, 0, -5,
+        -5, 0, 0, 0, 0, 0, 0, -5,
+        -5, 0, 0, 0, 0, 0, 0, -5,
+        -5, 0, 0, 0, 0, 0, 0, -5,
+        0, 0, 0, 5, 5, 0, 0, 0
+    },
+    {                           /* QUEEN */
+        -20, -10, -10, -5, -5, -10, -10, -20,
+        -10, 0, 0, 0, 0, 0, 0, -10,
+        -10, 0, 5, 5, 5, 5, 0, -10,
+        -5, 0, 5, 5, 5, 5, 0, -5,
+        0, 0, 5, 5, 5, 5, 0, -5,
+        -10, 5, 5, 5, 5, 5, 0, -10,
+        -10, 0, 5, 0, 0, 0, 0, -10,
+        -20, -10, -10, -5, -5, -10, -10, -20
+    },
+    {                           /* KING */
+        -30, -40, -40, -50, -50, -40, -40, -30,
+        -30, -40, -40, -50, -50, -40, -40, -30,
+        -30, -40, -40, -50, -50, -40, -40, -30,
+        -30, -40, -40, -50, -50, -40, -40, -30,
+        -20, -30, -30, -40, -40, -30, -30, -20,
+        -10, -20, -20, -20, -20, -20, -20, -10,
+        20, 20, 0, 0, 0, 0, 20, 20,
+        20, 30, 10, 0, 0, 10, 30, 20
     }
+};
+
+#define PST(c, p, pos) (pst_table[p][(c) == WHITE ? (pos) : (pos) ^ 56])
+
+/*
+   Pawn structure: doubled, isolated and passed pawns.  The score only
+   depends on where the pawns are, which seldom changes from one node to
+   the next, so it is kept in a small table per thread under pawn_key.
+ */
+#define DOUBLED_PAWN    10      /* for each pawn with another one on its file */
+#define ISOLATED_PAWN   15      /* no pawn of its color on the files next to it */
+#define PAWN_HASH_SIZE  (1 << 13)       /* entries, a power of two */
+
+const int       passed_pawn[8] =        /* by rank, counted from its own side */
+{0, 5, 10, 20, 35, 60, 100, 0};
+
+typedef struct tag_PAWNHASH {
+    BITBOARD        key;
+    int             score;      /* white's minus black's */
+}               PAWNHASH;
+
+THREAD PAWNHASH pawn_table[PAWN_HASH_SIZE];
+
+int             EvalPawns(void)
+{
+    int             c,
+                    pos,
+                    score[2] = {0, 0};
+    BITBOARD        own,
+                    other,
+                    pawns;
+    for (c = WHITE; c <= BLACK; c++) {
+        own = bb_piece[PAWN] & bb_color[c];
+        other = bb_piece[PAWN] & bb_color[(WHITE + BLACK) - c];
+        for (pawns = own; pawns;) {
+            pos = PopLsb(&pawns);
+            if (own & file_mask[COL(pos)] & ~BIT(pos))
+                score[c] -= DOUBLED_PAWN;
+            if (!(own & adjacent_files[COL(pos)]))
+                score[c] -= ISOLATED_PAWN;
+            if (!(other & passed_mask[c][pos]))
+                score[c] += passed_pawn[c == WHITE ? 7 - ROW(pos) : ROW(pos)];
+        }
+    }
+    return score[WHITE] - score[BLACK];
+}
+
+/* EvalPawns() of the current pawns, from the table if they were seen before */
+int             PawnStructure(void)
+{
+    PAWNHASH       *e = &pawn_table[pawn_key & (PAWN_HASH_SIZE - 1)];
+    if (e->key != pawn_key) {
+        e->key = pawn_key;
+        e->score = EvalPawns();
+    }
+    return e->score;
+}
+
+/* Sum up eval_sum from scratch; MakeMove keeps it up to date */
+void            InitEval(void)
+{
+    int             i;
+    memset(&eval_sum, 0, sizeof eval_sum);
+    for (i = 0; i < 64; i++)
+        if (color[i] != EMPTY) {
+            eval_sum.material[color[i]] += value_piece[piece[i]];
+            eval_sum.pst[color[i]] += PST(color[i], piece[i], i);
+        }
+}
+
+int             Eval()
+{
+    int             score;
+    score = eval_sum.material[WHITE] - eval_sum.material[BLACK]
+        + eval_sum.pst[WHITE] - eval_sum.pst[BLACK]
+        + PawnStructure();
     if (side == WHITE)
         return score;
     return -score;
@@ -351,164 +922,59 @@ int             Eval()
 int             IsInCheck(int current_side)
 {
     int             k,
-                    h,
-                    y,
-                    row,
-                    col,
                     xside;
+    BITBOARD        king;
     xside = (WHITE + BLACK) - current_side;     /* opposite current_side, who
                                                  * may be checking */
     /* Find King */
-    for (k = 0; k < 64; k++)
-        if (piece[k] == KING && color[k] == current_side)
-            break;
-
-    row = ROW(k), col = COL(k);
-    /* Check attacking of Knight */
-    if (col > 0 && row > 1 && color[k - 17] == xside && piece[k - 17] == KNIGHT)
-        return 1;
-    if (col < 7 && row > 1 && color[k - 15] == xside && piece[k - 15] == KNIGHT)
-        return 1;
-    if (col > 1 && row > 0 && color[k - 10] == xside && piece[k - 10] == KNIGHT)
-        return 1;
-    if (col < 6 && row > 0 && color[k - 6] == xside && piece[k - 6] == KNIGHT)
-        return 1;
-    if (col > 1 && row < 7 && color[k + 6] == xside && piece[k + 6] == KNIGHT)
-        return 1;
-    if (col < 6 && row < 7 && color[k + 10] == xside && piece[k + 10] == KNIGHT)
-        return 1;
-    if (col > 0 && row < 6 && color[k + 15] == xside && piece[k + 15] == KNIGHT)
-        return 1;
-    if (col < 7 && row < 6 && color[k + 17] == xside && piece[k + 17] == KNIGHT)
-        return 1;
-    /* Check horizontal and vertical lines for attacking of Queen, Rook, King */
-    /* go down */
-    y = k + 8;
-    if (y < 64) {
-        if (color[y] == xside && (piece[y] == KING || piece[y] == QUEEN || piece[y] == ROOK))
-            return 1;
-        if (piece[y] == EMPTY)
-            for (y += 8; y < 64; y += 8) {
-                if (color[y] == xside && (piece[y] == QUEEN || piece[y] == ROOK))
-                    return 1;
-                if (piece[y] != EMPTY)
-                    break;
-
-            }
-    }
-    /* go left */
-    y = k - 1;
-    h = k - col;
-    if (y >= h) {
-        if (color[y] == xside && (piece[y] == KING || piece[y] == QUEEN || piece[y] == ROOK))
-            return 1;
-        if (piece[y] == EMPTY)
-            for (y--; y >= h; y--) {
-                if (color[y] == xside && (piece[y] == QUEEN || piece[y] == ROOK))
-                    return 1;
-                if (piece[y] != EMPTY)
-                    break;
-            }
-    }
-    /* go right */
-    y = k + 1;
-    h = k - col + 7;
-    if (y <= h) {
-        if (color[y] == xside && (piece[y] == KING || piece[y] == QUEEN || piece[y] == ROOK))
-            return 1;
-        if (piece[y] == EMPTY)
-            for (y++; y <= h; y++) {
-                if (color[y] == xside && (piece[y] == QUEEN || piece[y] == ROOK))
-                    return 1;
-                if (piece[y] != EMPTY)
-                    break;
-            }
-    }
-    /* go up */
-    y = k - 8;
-    if (y >= 0) {
-        if (color[y] == xside && (piece[y] == KING || piece[y] == QUEEN || piece[y] == ROOK))
-            return 1;
-        if (piece[y] == EMPTY)
-            for (y -= 8; y >= 0; y -= 8) {
-                if (color[y] == xside && (piece[y] == QUEEN || piece[y] == ROOK))
-                    return 1;
-                if (piece[y] != EMPTY)
-                    break;
-            }
-    }
-    /* Check diagonal lines for attacking of Queen, Bishop, King, Pawn */
-    /* go right down */
-    y = k + 9;
-    if (y < 64 && COL(y) != 0) {
-        if (color[y] == xside) {
-            if (piece[y] == KING || piece[y] == QUEEN || piece[y] == BISHOP)
-                return 1;
-            if (current_side == BLACK && piece[y] == PAWN)
-                return 1;
-        }
-        if (piece[y] == EMPTY)
-            for (y += 9; y < 64 && COL(y) != 0; y += 9) {
-                if (color[y] == xside && (piece[y] == QUEEN || piece[y] == BISHOP))
-                    return 1;
-                if (piece[y] != EMPTY)
-                    break;
-            }
-    }
-    /* go left down */
-    y = k + 7;
-    if (y < 64 && COL(y) != 7) {
-        if (color[y] == xside) {
-            if (piece[y] == KING || piece[y] == QUEEN || piece[y] == BISHOP)
-                return 1;
-            if (current_side == BLACK && piece[y] == PAWN)
-                return 1;
-        }
-        if (piece[y] == EMPTY)
-            for (y += 7; y < 64 && COL(y) != 7; y += 7) {
-                if (color[y] == xside && (piece[y] == QUEEN || piece[y] == BISHOP))
-                    return 1;
-                if (piece[y] != EMPTY)
-                    break;
-
-            }
-    }
-    /* go left up */
-    y = k - 9;
-    if (y >= 0 && COL(y) != 7) {
-        if (color[y] == xside) {
-            if (piece[y] == KING || piece[y] == QUEEN || piece[y] == BISHOP)
-                return 1;
-            if (current_side == WHITE && piece[y] == PAWN)
-                return 1;
-        }
-        if (piece[y] == EMPTY)
-            for (y -= 9; y >= 0 && COL(y) != 7; y -= 9) {
-                if (color[y] == xside && (piece[y] == QUEEN || piece[y] == BISHOP))
-                    return 1;
-                if (piece[y] != EMPTY)
-                    break;
+    king = bb_piece[KING] & bb_color[current_side];
+    if (!king)
+        return 0;
+    k = LSB(king);
+    return (AttacksTo(k, bb_color[WHITE] | bb_color[BLACK]) & bb_color[xside]) != 0;
+}
 
-            }
+/*
+   Static exchange evaluation: the material the side to move wins with m
+   if both sides then take turns recapturing on m.dest, always with their
+   least valuable piece, and each stops as soon as going on would lose.
+   Pieces behind the ones that captured join in as they are uncovered.
+ */
+int             SEE(MOVE m)
+{
+    int             gain[32],
+                    d = 0,
+                    p,
+                    s = (WHITE + BLACK) - side,
+                    on_square;
+    BITBOARD        occupied = bb_color[WHITE] | bb_color[BLACK],
+                    attackers,
+                    mine;
+
+    gain[0] = value_piece[piece[m.dest]];
+    on_square = value_piece[piece[m.from]];
+    if (m.type >= MOVE_TYPE_PROMOTION_TO_QUEEN) {
+        on_square = value_piece[QUEEN - (m.type - MOVE_TYPE_PROMOTION_TO_QUEEN)];
+        gain[0] += on_square - VALUE_PAWN;
     }
-    /* go right up */
-    y = k - 7;
-    if (y >= 0 && COL(y) != 0) {
-        if (color[y] == xside) {
-            if (piece[y] == KING || piece[y] == QUEEN || piece[y] == BISHOP)
-                return 1;
-            if (current_side == WHITE && piece[y] == PAWN)
-                return 1;
-        }
-        if (piece[y] == EMPTY)
-            for (y -= 7; y >= 0 && COL(y) != 0; y -= 7) {
-                if (color[y] == xside && (piece[y] == QUEEN || piece[y] == BISHOP))
-                    return 1;
-                if (piece[y] != EMPTY)
-                    break;
-            }
+    occupied ^= BIT(m.from);
+    attackers = AttacksTo(m.dest, occupied) & occupied;
+    while (d < 31 && (mine = attackers & bb_color[s])) {
+        for (p = PAWN; !(mine & bb_piece[p]); p++);
+        /* the King may only take when nothing takes it back */
+        if (p == KING && (attackers & bb_color[(WHITE + BLACK) - s]))
+            break;
+        d++;
+        gain[d] = on_square - gain[d - 1];
+        occupied ^= BIT(LSB(mine & bb_piece[p]));
+        attackers = AttacksTo(m.dest, occupied) & occupied;
+        on_square = value_piece[p];
+        s = (WHITE + BLACK) - s;
     }
-    return 0;
+    for (; d > 0; d--)
+        if (-gain[d] < gain[d - 1])
+            gain[d - 1] = -gain[d];
+    return gain[0];
 }
 
 int             MakeMove(MOVE m)
@@ -516,6 +982,27 @@ int             MakeMove(MOVE m)
     int             r;
     hist[hdp].m = m;
     hist[hdp].cap = piece[m.dest];
+    hist[hdp].hash = hash_key;
+    hist[hdp].pawn_hash = pawn_key;
+    hist[hdp].sum = eval_sum;
+    if (piece[m.from] == PAWN) {
+        pawn_key ^= zobrist_piece[side][PAWN][m.from];
+        if (m.type < MOVE_TYPE_PROMOTION_TO_QUEEN)
+            pawn_key ^= zobrist_piece[side][PAWN][m.dest];
+    }
+    if (piece[m.dest] == PAWN)
+        pawn_key ^= zobrist_piece[(WHITE + BLACK) - side][PAWN][m.dest];
+    bb_color[side] ^= BIT(m.from) | BIT(m.dest);
+    bb_piece[piece[m.from]] ^= BIT(m.from);
+    hash_key ^= zobrist_piece[side][piece[m.from]][m.from] ^ zobrist_side;
+    eval_sum.pst[side] -= PST(side, piece[m.from], m.from);
+    if (piece[m.dest] != EMPTY) {
+        bb_color[(WHITE + BLACK) - side] ^= BIT(m.dest);
+        bb_piece[piece[m.dest]] ^= BIT(m.dest);
+        hash_key ^= zobrist_piece[(WHITE + BLACK) - side][piece[m.dest]][m.dest];
+        eval_sum.material[(WHITE + BLACK) - side] -= value_piece[piece[m.dest]];
+        eval_sum.pst[(WHITE + BLACK) - side] -= PST((WHITE + BLACK) - side, piece[m.dest], m.dest);
+    }
     piece[m.dest] = piece[m.from];
     piece[m.from] = EMPTY;
     color[m.dest] = color[m.from];
@@ -542,7 +1029,11 @@ int             MakeMove(MOVE m)
             puts("impossible to get here...");
             assert(false);
         }
+        eval_sum.material[side] += value_piece[piece[m.dest]] - VALUE_PAWN;
     }
+    bb_piece[piece[m.dest]] ^= BIT(m.dest);
+    hash_key ^= zobrist_piece[side][piece[m.dest]][m.dest];
+    eval_sum.pst[side] += PST(side, piece[m.dest], m.dest);
     ply++;
     hdp++;
     r = !IsInCheck(side);
@@ -556,6 +1047,15 @@ void            TakeBack()
     side = (WHITE + BLACK) - side;
     hdp--;
     ply--;
+    hash_key = hist[hdp].hash;
+    pawn_key = hist[hdp].pawn_hash;
+    eval_sum = hist[hdp].sum;
+    bb_color[side] ^= BIT(hist[hdp].m.from) | BIT(hist[hdp].m.dest);
+    bb_piece[piece[hist[hdp].m.dest]] ^= BIT(hist[hdp].m.dest);
+    if (hist[hdp].cap != EMPTY) {
+        bb_color[(WHITE + BLACK) - side] ^= BIT(hist[hdp].m.dest);
+        bb_piece[hist[hdp].cap] ^= BIT(hist[hdp].m.dest);
+    }
     piece[hist[hdp].m.from] = piece[hist[hdp].m.dest];
     piece[hist[hdp].m.dest] = hist[hdp].cap;
     color[hist[hdp].m.from] = side;
@@ -565,6 +1065,27 @@ void            TakeBack()
         color[hist[hdp].m.dest] = EMPTY;
     if (hist[hdp].m.type >= MOVE_TYPE_PROMOTION_TO_QUEEN)       /* Promotion */
         piece[hist[hdp].m.from] = PAWN;
+    bb_piece[piece[hist[hdp].m.from]] ^= BIT(hist[hdp].m.from);
+}
+
+/* Pass the turn without moving; kept in hist[] as a move of type NONE */
+void            MakeNullMove()
+{
+    hist[hdp].m.type = MOVE_TYPE_NONE;
+    hist[hdp].cap = EMPTY;
+    hist[hdp].hash = hash_key;
+    hash_key ^= zobrist_side;
+    ply++;
+    hdp++;
+    side = (WHITE + BLACK) - side;
+}
+
+void            TakeBackNull()
+{
+    side = (WHITE + BLACK) - side;
+    hdp--;
+    ply--;
+    hash_key = hist[hdp].hash;
 }
 
 /*
@@ -574,41 +1095,472 @@ void            TakeBack()
    ****************************************************************************
  */
 
-int             Search(int alpha, int beta, int depth, MOVE * pBestMove)
+/* Milliseconds of a monotonic clock */
+int64_t         GetMs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*
+   Move ordering: Search() gets its moves from a picker that works in
+   stages, and only generates the moves of a stage once the ones before
+   it are used up, so a cutoff by the hash move or an early capture saves
+   generating the rest.  The stages are the hash move, the captures by
+   MVV-LVA, the two killers of the ply, the quiet moves by their history,
+   and last the captures that lose material by SEE().  Within a stage the
+   best scored move left is picked each time.
+ */
+#define MAX_PLY         64
+#define HISTORY_MAX     (1 << 26)       /* history is halved when an entry gets here */
+
+#define STAGE_HASH          0
+#define STAGE_GEN_CAPTURES  1
+#define STAGE_CAPTURES      2
+#define STAGE_KILLERS       3
+#define STAGE_GEN_QUIETS    4
+#define STAGE_QUIETS        5
+#define STAGE_BAD_CAPTURES  6
+#define STAGE_DONE          7
+
+#define SAME_MOVE(a, b) ((a).from == (b).from && (a).dest == (b).dest && (a).type == (b).type)
+
+THREAD MOVE     killers[MAX_PLY][2];    /* quiet moves that caused a cutoff at this ply */
+THREAD int      history[2][64][64];     /* side, from, dest: how often and how deep a
+                                         * quiet move caused a cutoff */
+
+typedef struct tag_PICKER {
+    MOVE           *pBuf;       /* moveBuf[200] of the ply, captures then quiets */
+    int            *order;      /* ordering scores of pBuf */
+    int             movecnt,    /* moves generated so far */
+                    capcnt,     /* captures, they come first in pBuf */
+                    bad,        /* first capture that loses material */
+                    next,       /* next move of the stage to hand out */
+                    stage;
+    uint16_t        hashmove;   /* 0 if there is none */
+    MOVE            killer[2];  /* type MOVE_TYPE_NONE once known not to be played */
+}               PICKER;
+
+/*
+   Captures by MVV-LVA, quiet moves by history.  A capture that loses
+   material by SEE() gets what it loses, the only scores below 0.
+ */
+void            ScoreMoves(MOVE * pBuf, int *order, int movecnt)
+{
+    int             i,
+                    see;
+    for (i = 0; i < movecnt; ++i) {
+        if (color[pBuf[i].dest] != EMPTY || pBuf[i].type >= MOVE_TYPE_PROMOTION_TO_QUEEN) {
+            /* most valuable victim first, least valuable attacker first among those */
+            order[i] = value_piece[piece[pBuf[i].dest]] * 8 - piece[pBuf[i].from]
+                + (pBuf[i].type == MOVE_TYPE_PROMOTION_TO_QUEEN ? VALUE_QUEEN * 8 : 0);
+            /* only a capture by a more valuable piece can lose */
+            if (pBuf[i].type < MOVE_TYPE_PROMOTION_TO_QUEEN
+                && value_piece[piece[pBuf[i].dest]] < value_piece[piece[pBuf[i].from]]
+                && (see = SEE(pBuf[i])) < 0)
+                order[i] = see;
+        } else
+            order[i] = history[side][pBuf[i].from][pBuf[i].dest];
+    }
+}
+
+/* Swap the best scored of the moves from i on into place i */
+void            PickMove(MOVE * pBuf, int *order, int i, int movecnt)
+{
+    int             j,
+                    best = i,
+                    tmp;
+    MOVE            tmpMove;
+    for (j = i + 1; j < movecnt; ++j)
+        if (order[j] > order[best])
+            best = j;
+    tmp = order[i];
+    order[i] = order[best];
+    order[best] = tmp;
+    tmpMove = pBuf[i];
+    pBuf[i] = pBuf[best];
+    pBuf[best] = tmpMove;
+}
+
+void            AgeHistory(void)
+{
+    int             c,
+                    from,
+                    dest;
+    for (c = 0; c < 2; c++)
+        for (from = 0; from < 64; from++)
+            for (dest = 0; dest < 64; dest++)
+                history[c][from][dest] /= 2;
+}
+
+/* A quiet move caused a cutoff: keep it as a killer and in the history */
+void            QuietCutoff(MOVE m, int depth)
+{
+    if (ply < MAX_PLY && !SAME_MOVE(m, killers[ply][0])) {
+        killers[ply][1] = killers[ply][0];
+        killers[ply][0] = m;
+    }
+    history[side][m.from][m.dest] += depth * depth;
+    if (history[side][m.from][m.dest] >= HISTORY_MAX)
+        AgeHistory();
+}
+
+void            InitPicker(PICKER * p, MOVE * pBuf, int *order, uint16_t hashmove)
+{
+    p->pBuf = pBuf;
+    p->order = order;
+    p->movecnt = 0;
+    p->capcnt = 0;
+    p->bad = 0;
+    p->next = 0;
+    p->stage = STAGE_HASH;
+    p->hashmove = hashmove;
+    if (ply < MAX_PLY) {
+        p->killer[0] = killers[ply][0];
+        p->killer[1] = killers[ply][1];
+    } else
+        p->killer[0].type = p->killer[1].type = MOVE_TYPE_NONE;
+}
+
+/* Put the next move to try in *m, return false when there are no more */
+mybool          NextMove(PICKER * p, MOVE * m)
+{
+    switch (p->stage) {
+    case STAGE_HASH:
+        p->stage = STAGE_GEN_CAPTURES;
+        if (p->hashmove) {
+            m->from = p->hashmove & 63;
+            m->dest = (p->hashmove >> 6) & 63;
+            m->type = p->hashmove >> 12;
+            if (IsPseudoLegal(*m))
+                return true;
+            p->hashmove = 0;
+        }
+        /* fall through */
+    case STAGE_GEN_CAPTURES:
+        p->movecnt = p->capcnt = GenCaptures(side, p->pBuf);
+        ScoreMoves(p->pBuf, p->order, p->capcnt);
+        p->next = 0;
+        p->stage = STAGE_CAPTURES;
+        /* fall through */
+    case STAGE_CAPTURES:
+        while (p->next < p->capcnt) {
+            PickMove(p->pBuf, p->order, p->next, p->capcnt);
+            if (p->order[p->next] < 0)
+                break;          /* the rest lose material, they go last */
+            *m = p->pBuf[p->next++];
+            if (PACK_MOVE(*m) != p->hashmove)
+                return true;
+        }
+        p->bad = p->next;
+        p->next = 0;
+        p->stage = STAGE_KILLERS;
+        /* fall through */
+    case STAGE_KILLERS:
+        while (p->next < 2) {
+            *m = p->killer[p->next++];
+            /* a killer that is a capture here was tried with the captures */
+            if (m->type == MOVE_TYPE_NORMAL && color[m->dest] == EMPTY
+                && PACK_MOVE(*m) != p->hashmove && IsPseudoLegal(*m))
+                return true;
+            p->killer[p->next - 1].type = MOVE_TYPE_NONE;
+        }
+        p->stage = STAGE_GEN_QUIETS;
+        /* fall through */
+    case STAGE_GEN_QUIETS:
+        p->next = p->movecnt;
+        p->movecnt += GenQuiets(side, p->pBuf + p->movecnt);
+        ScoreMoves(p->pBuf + p->next, p->order + p->next, p->movecnt - p->next);
+        p->stage = STAGE_QUIETS;
+        /* fall through */
+    case STAGE_QUIETS:
+        while (p->next < p->movecnt) {
+            PickMove(p->pBuf, p->order, p->next, p->movecnt);
+            *m = p->pBuf[p->next++];
+            if (PACK_MOVE(*m) != p->hashmove
+                && !SAME_MOVE(*m, p->killer[0]) && !SAME_MOVE(*m, p->killer[1]))
+                return true;
+        }
+        p->next = p->bad;
+        p->stage = STAGE_BAD_CAPTURES;
+        /* fall through */
+    case STAGE_BAD_CAPTURES:
+        while (p->next < p->capcnt) {
+            PickMove(p->pBuf, p->order, p->next, p->capcnt);
+            *m = p->pBuf[p->next++];
+            if (PACK_MOVE(*m) != p->hashmove)
+                return true;
+        }
+        p->stage = STAGE_DONE;
+    }
+    return false;
+}
+
+/*
+   Null move pruning: if the side to move could pass and a reduced search
+   still fails high, a real move will most likely fail high too.  That is
+   wrong in zugzwang, so there is no null move in check, with only pawns
+   left, or right after another null move, and deep enough a fail high is
+   verified by a reduced search of the real moves, with the null move off
+   for the plies that search covers.
+ */
+#define NULL_MIN_DEPTH      2   /* no null move closer to the leaves */
+#define NULL_R              2   /* depth reduction of the null move search */
+#define NULL_R_DEEP         3   /* ... from NULL_DEEP on */
+#define NULL_DEEP           7
+#define NULL_VERIFY_DEPTH   8   /* fail highs from here on are verified */
+
+THREAD int      null_min_ply;   /* no null move before this ply, see above */
+
+/* Whether Search() may try a null move here */
+mybool          NullMoveOk(int beta, int depth, int in_check, int static_eval)
+{
+    return ply > 0 && ply >= null_min_ply && depth >= NULL_MIN_DEPTH
+        && beta < MATE - 1000
+        && (hdp == 0 || hist[hdp - 1].m.type != MOVE_TYPE_NONE)
+        && (bb_color[side] & ~(bb_piece[PAWN] | bb_piece[KING])) != 0
+        && !in_check
+        && static_eval >= beta;
+}
+
+/*
+   Late move reductions: quiet moves that come after the hash move, the
+   captures, the killers and the first few quiets are searched less deep,
+   by about log(depth) * log(move number) / 4 plies, with a null window.
+   One that still beats alpha is searched again at full depth.
+
+   Near the leaves the static score decides: at depth 1 and 2, razoring
+   hands a node that is far below alpha straight to Quiesce(), and
+   futility pruning skips the quiet moves of a node that is too far below
+   alpha for one quiet move to bring it back.  Neither is done in check,
+   and a quiet move that gives check is never pruned or reduced.
+
+   Each can be compiled off by default with -DUSE_LMR=0, -DUSE_FUTILITY=0
+   or -DUSE_RAZORING=0, and switched with the lmr, futility and razor
+   commands, to see what it saves.
+ */
+#ifndef USE_LMR
+#define USE_LMR         1
+#endif
+#ifndef USE_FUTILITY
+#define USE_FUTILITY    1
+#endif
+#ifndef USE_RAZORING
+#define USE_RAZORING    1
+#endif
+
+#define LMR_MIN_DEPTH   3       /* no reductions closer to the leaves */
+#define LMR_FULL_MOVES  3       /* legal moves searched in full at every node */
+#define FRONTIER_DEPTH  2       /* futility and razoring up to this depth */
+
+const int       futility_margin[FRONTIER_DEPTH + 1] = {0, 200, 500};
+const int       razor_margin[FRONTIER_DEPTH + 1] = {0, 300, 500};
+
+int             use_lmr = USE_LMR;
+int             use_futility = USE_FUTILITY;
+int             use_razoring = USE_RAZORING;
+
+/* 16 * log2(n), straight lines between the powers of two */
+int             Log2x16(int n)
+{
+    int             b = 31 - __builtin_clz(n);
+    return 16 * b + 16 * (n - (1 << b)) / (1 << b);
+}
+
+/* Switch lmr, futility or razor off (0) or on */
+void            SetPruning(const char *name, int on)
+{
+    if (!strcmp(name, "lmr"))
+        use_lmr = on != 0;
+    else if (!strcmp(name, "futility"))
+        use_futility = on != 0;
+    else if (!strcmp(name, "razor"))
+        use_razoring = on != 0;
+}
+
+/* Plies the movenum-th legal move at this depth is reduced by */
+int             LmrReduction(int depth, int movenum)
+{
+    int             r = Log2x16(depth) * Log2x16(movenum) / 1024;
+    return r > depth - 2 ? depth - 2 : r;
+}
+
+/*
+   Quiescence search: only captures and promotions are searched until the
+   position is quiet, so Search() never stops in the middle of an exchange.
+   The side to move may always "stand pat" on the static score instead,
+   so captures that lose material by SEE() are not searched at all.
+ */
+int             Quiesce(int alpha, int beta)
 {
     int             i,
                     value,
+                    stand_pat,
+                    movecnt,
+                    order[200];
+    MOVE            moveBuf[200];
+
+    nodes++;
+    if (deadline && (nodes & CHECK_NODES) == 0 && GetMs() >= deadline)
+        ATOMIC_STORE(stop_search, 1);
+    stand_pat = Eval();
+    if (stand_pat >= beta)
+        return beta;
+    if (stand_pat > alpha)
+        alpha = stand_pat;
+    movecnt = GenCaptures(side, moveBuf);
+    ScoreMoves(moveBuf, order, movecnt);
+    for (i = 0; i < movecnt; ++i) {
+        PickMove(moveBuf, order, i, movecnt);
+        if (order[i] < 0)
+            break;              /* the rest lose material by SEE() */
+        /* delta pruning: even winning this piece for free won't reach alpha */
+        if (moveBuf[i].type < MOVE_TYPE_PROMOTION_TO_QUEEN
+            && stand_pat + value_piece[piece[moveBuf[i].dest]] + DELTA_MARGIN <= alpha)
+            continue;
+        if (!MakeMove(moveBuf[i])) {
+            TakeBack();
+            continue;
+        }
+        value = -Quiesce(-beta, -alpha);
+        TakeBack();
+        if (ATOMIC_LOAD(stop_search))
+            return 0;
+        if (value > alpha) {
+            if (value >= beta)
+                return beta;
+            alpha = value;
+        }
+    }
+    return alpha;
+}
+
+int             Search(int alpha, int beta, int depth, MOVE * pBestMove)
+{
+    int             value,
                     havemove,
-                    movecnt;
+                    movenum = 0,
+                    oldalpha = alpha,
+                    r,
+                    saved_min_ply,
+                    in_check,
+                    static_eval,
+                    futile,
+                    quiet,
+                    gives_check,
+                    order[200];
     MOVE            moveBuf[200],
+                    move,
                     tmpMove;
+    PICKER          picker;
+    HASHDATA        entry;
+    uint16_t        hashmove = 0;
 
+    if (depth <= 0)             /* If no depth left (leaf node), resolve the
+                                 * captures before evaluating */
+        return Quiesce(alpha, beta);
     nodes++;                    /* visiting a node, count it */
+    if (deadline && (nodes & CHECK_NODES) == 0 && GetMs() >= deadline)
+        ATOMIC_STORE(stop_search, 1);
     havemove = 0;
     pBestMove->type = MOVE_TYPE_NONE;
-    movecnt = Gen(side, moveBuf);       /* generate all moves for current
-                                         * position */
-    /* loop through the moves */
-    for (i = 0; i < movecnt; ++i) {
-        if (!MakeMove(moveBuf[i])) {
+    if (ProbeHash(&entry)) {
+        hashmove = entry.move;
+        /* the root always searches, it has to return a move */
+        if (ply && entry.depth >= depth) {
+            value = ScoreFromHash(entry.score);
+            if (entry.bound == HASH_EXACT)
+                return value >= beta ? beta : (value <= alpha ? alpha : value);
+            if (entry.bound == HASH_LOWER && value >= beta)
+                return beta;
+            if (entry.bound == HASH_UPPER && value <= alpha)
+                return alpha;
+        }
+    }
+    in_check = IsInCheck(side);
+    static_eval = in_check ? -MATE : Eval();
+    /* razoring */
+    if (use_razoring && ply && depth <= FRONTIER_DEPTH && !in_check
+        && alpha > -MATE + 1000 && static_eval + razor_margin[depth] <= alpha) {
+        r = alpha - razor_margin[depth];
+        value = Quiesce(r, r + 1);
+        if (ATOMIC_LOAD(stop_search))
+            return 0;
+        if (value <= r)
+            return alpha;
+    }
+    if (NullMoveOk(beta, depth, in_check, static_eval)) {
+        r = depth >= NULL_DEEP ? NULL_R_DEEP : NULL_R;
+        MakeNullMove();
+        value = -Search(-beta, -beta + 1, depth - 1 - r, &tmpMove);
+        TakeBackNull();
+        if (ATOMIC_LOAD(stop_search))
+            return 0;
+        if (value >= beta) {
+            if (depth < NULL_VERIFY_DEPTH)
+                return beta;
+            saved_min_ply = null_min_ply;
+            null_min_ply = ply + 3 * (depth - r) / 4;
+            value = Search(beta - 1, beta, depth - r, &tmpMove);
+            null_min_ply = saved_min_ply;
+            if (ATOMIC_LOAD(stop_search))
+                return 0;
+            if (value >= beta)
+                return beta;
+        }
+    }
+    futile = use_futility && ply && depth <= FRONTIER_DEPTH && !in_check
+        && alpha > -MATE + 1000 && alpha < MATE - 1000
+        && static_eval + futility_margin[depth] <= alpha;
+    /* loop through the moves, generated stage by stage */
+    InitPicker(&picker, moveBuf, order, hashmove);
+    while (NextMove(&picker, &move)) {
+        quiet = color[move.dest] == EMPTY && move.type < MOVE_TYPE_PROMOTION_TO_QUEEN;
+        if (!MakeMove(move)) {
             TakeBack();
             continue;
         }
         havemove = 1;
-        if (depth - 1 > 0)      /* If depth is still, continue to search
-                                 * deeper */
+        movenum++;
+        gives_check = quiet && IsInCheck(side);
+        /* futility pruning, once there is a move to fail low with */
+        if (futile && quiet && movenum > 1 && !gives_check) {
+            TakeBack();
+            continue;
+        }
+        r = 0;
+        if (use_lmr && depth >= LMR_MIN_DEPTH && movenum > LMR_FULL_MOVES
+            && picker.stage == STAGE_QUIETS && !in_check && !gives_check)
+            r = LmrReduction(depth, movenum);
+        /*
+           Principal variation search: the first move gets the full window,
+           the others a null window that only tells whether they beat alpha.
+           One that does, and may still be below beta or was reduced, is
+           searched again with the full window.
+         */
+        if (movenum == 1)
             value = -Search(-beta, -alpha, depth - 1, &tmpMove);
-        else                    /* If no depth left (leaf node), go to
-                                 * evalute that position */
-            value = Eval();
+        else {
+            value = -Search(-alpha - 1, -alpha, depth - 1 - r, &tmpMove);
+            if (value > alpha && (value < beta || r > 0) && !ATOMIC_LOAD(stop_search))
+                value = -Search(-beta, -alpha, depth - 1, &tmpMove);
+        }
         TakeBack();
+        /* a stopped search returns without storing what it did not finish */
+        if (ATOMIC_LOAD(stop_search))
+            return 0;
         if (value > alpha) {
             /* This move is so good and caused a cutoff */
-            if (value >= beta)
+            if (value >= beta) {
+                if (color[move.dest] == EMPTY && move.type < MOVE_TYPE_PROMOTION_TO_QUEEN)
+                    QuietCutoff(move, depth);
+                StoreHash(depth, HASH_LOWER, ScoreToHash(beta), move);
                 return beta;
+            }
             alpha = value;
-            *pBestMove = moveBuf[i];    /* so far, current move is the best
-                                         * reaction for current position */
+            *pBestMove = move;  /* so far, current move is the best
+                                 * reaction for current position */
         }
     }
     if (!havemove) {            /* If no legal moves, that is checkmate or
@@ -619,19 +1571,134 @@ int             Search(int alpha, int beta, int depth, MOVE * pBestMove)
         else
             return 0;
     }
+    StoreHash(depth, alpha > oldalpha ? HASH_EXACT : HASH_UPPER, ScoreToHash(alpha), *pBestMove);
     return alpha;
 }
 
+/*
+   Lazy SMP: the helper threads run their own iterative deepening on a copy
+   of the root position until the main search is done.  They only help by
+   filling the shared hash table; odd helpers start one ply deeper so the
+   threads don't all search the same tree at the same time.
+ */
+typedef struct tag_HELPER {
+    pthread_t       thread;
+    int             id;
+    int             nodes;      /* visited by this helper */
+}               HELPER;
+
+int             root_piece[64],
+                root_color[64],
+                root_side;
+
+void           *HelperThink(void *arg)
+{
+    HELPER         *h = arg;
+    MOVE            m;
+    int             depth;
+    memcpy(piece, root_piece, sizeof piece);
+    memcpy(color, root_color, sizeof color);
+    side = root_side;
+    hdp = 0;
+    ply = 0;
+    nodes = 0;
+    InitBitboards();
+    InitEval();
+    hash_key = ComputeHash();
+    pawn_key = ComputePawnHash();
+    for (depth = 1 + (h->id & 1); depth < 64 && !ATOMIC_LOAD(stop_search); depth++)
+        Search(-MATE, MATE, depth, &m);
+    h->nodes = nodes;
+    return NULL;
+}
+
+/*
+   Iterative deepening: search depth 1, 2, ... and return the move of the
+   last iteration that finished.  No new iteration starts after time_soft;
+   once depth 1 is done, Search() gives up after time_hard.
+
+   From ASPIRATION_DEPTH on, an iteration starts with a window around the
+   score of the last one.  If the score falls outside, the side it failed
+   on is widened by four times as much each time, until the window is
+   wider than ASPIRATION_MAX and the search goes on with the full window.
+ */
+#define ASPIRATION_DEPTH    4
+#define ASPIRATION_WINDOW   25  /* half width of the first window */
+#define ASPIRATION_MAX      1000
+
 MOVE
 ComputerThink(int max_depth)
 {
-    MOVE            m;
-    int             score;
+    MOVE            m,
+                    best;
+    int             score,
+                    best_score = 0,
+                    depth,
+                    alpha,
+                    beta,
+                    delta,
+                    i,
+                    helpers = 0;
+    int64_t         start = GetMs();
+    HELPER          helper[MAX_THREADS];
     /* reset some values before searching */
     ply = 0;
     nodes = 0;
+    hash_age++;                 /* entries of earlier searches go first */
+    memset(killers, 0, sizeof killers);
+    AgeHistory();
+    null_min_ply = 0;
+    /* start the helpers on the root position */
+    memcpy(root_piece, piece, sizeof root_piece);
+    memcpy(root_color, color, sizeof root_color);
+    root_side = side;
+    ATOMIC_STORE(stop_search, 0);
+    for (i = 1; i < threads; i++) {
+        helper[helpers].id = i;
+        if (!pthread_create(&helper[helpers].thread, NULL, HelperThink, &helper[helpers]))
+            helpers++;
+    }
     /* search now */
-    score = Search(-MATE, MATE, max_depth, &m);
+    best.type = MOVE_TYPE_NONE;
+    deadline = 0;
+    for (depth = 1; depth <= max_depth; depth++) {
+        delta = ASPIRATION_WINDOW;
+        alpha = -MATE;
+        beta = MATE;
+        if (depth >= ASPIRATION_DEPTH && best_score > -MATE + 1000 && best_score < MATE - 1000) {
+            alpha = best_score - delta;
+            beta = best_score + delta;
+        }
+        for (;;) {
+            score = Search(alpha, beta, depth, &m);
+            if (ATOMIC_LOAD(stop_search))
+                break;
+            delta *= 4;
+            if (score <= alpha && alpha > -MATE)
+                alpha = delta > ASPIRATION_MAX ? -MATE : score - delta;
+            else if (score >= beta && beta < MATE)
+                beta = delta > ASPIRATION_MAX ? MATE : score + delta;
+            else
+                break;
+        }
+        if (ATOMIC_LOAD(stop_search))
+            break;              /* out of time, this iteration is lost */
+        best = m;
+        best_score = score;
+        if (time_hard)
+            deadline = start + time_hard;
+        if (time_soft && GetMs() - start >= time_soft)
+            break;
+    }
+    deadline = 0;
+    m = best;
+    score = best_score;
+    ATOMIC_STORE(stop_search, 1);
+    for (i = 0; i < helpers; i++) {
+        pthread_join(helper[i].thread, NULL);
+        nodes += helper[i].nodes;
+    }
+    ATOMIC_STORE(stop_search, 0);
     /* after searching, print results */
     printf("Search result: move = %c%d%c%d; nodes = %d, score = %d\n",
            'a' + COL(m.from),
@@ -644,6 +1711,218 @@ ComputerThink(int max_depth)
     return m;
 }
 
+/*
+   ****************************************************************************
+   * Perft - move generator test                                              *
+   ****************************************************************************
+ */
+/*
+   Perft counts the leaves of the legal move tree to a given depth, to check
+   Gen(), MakeMove() and TakeBack() against known counts and to time them.
+   FirstChess has no castling and no en passant, so from the start position
+   the counts agree with the published ones up to depth 4 only.
+
+   With bulk counting the moves of the last ply are not made: a move there
+   counts when KingSafeAfter() says it is legal.  The optional table keeps
+   the counts of subtrees, so a transposition is only walked once.  Like
+   the transposition table it is shared without locks, an entry keeping
+   its key xor-ed with its data.  Threads split up the root moves.
+ */
+typedef struct tag_PERFTHASH {
+    uint64_t        lock;       /* key ^ data */
+    uint64_t        data;       /* count << 6 | depth */
+}               PERFTHASH;
+
+PERFTHASH      *perft_table = NULL;
+uint64_t        perft_mask;     /* number of entries - 1 */
+int             perft_bulk,
+                perft_depth;
+MOVE            perft_moves[200];       /* legal root moves */
+uint64_t        perft_counts[200];      /* leaves below each of them */
+int             perft_movecnt,
+                perft_next;     /* next root move to hand out */
+
+/* Whether m leaves the King of the side to move safe, without making it */
+int             KingSafeAfter(MOVE m)
+{
+    BITBOARD        occupied = ((bb_color[WHITE] | bb_color[BLACK]) ^ BIT(m.from)) | BIT(m.dest),
+                    king = bb_piece[KING] & bb_color[side];
+    if (!king)
+        return 1;
+    return !(AttacksTo(piece[m.from] == KING ? m.dest : LSB(king), occupied)
+             & bb_color[(WHITE + BLACK) - side] & ~BIT(m.dest));
+}
+
+uint64_t        Perft(int depth)
+{
+    MOVE            moveBuf[200];
+    int             movecnt,
+                    i;
+    uint64_t        count = 0,
+                    data;
+    PERFTHASH      *e = NULL;
+
+    if (perft_table && depth > 1) {
+        e = &perft_table[hash_key & perft_mask];
+        data = ATOMIC_LOAD(e->data);
+        if ((ATOMIC_LOAD(e->lock) ^ data) == hash_key && (int) (data & 63) == depth)
+            return data >> 6;
+    }
+    movecnt = Gen(side, moveBuf);
+    for (i = 0; i < movecnt; ++i) {
+        if (depth == 1 && perft_bulk)
+            count += KingSafeAfter(moveBuf[i]);
+        else {
+            if (MakeMove(moveBuf[i]))
+                count += depth > 1 ? Perft(depth - 1) : 1;
+            TakeBack();
+        }
+    }
+    if (e) {
+        data = count << 6 | depth;
+        ATOMIC_STORE(e->data, data);
+        ATOMIC_STORE(e->lock, hash_key ^ data);
+    }
+    return count;
+}
+
+/* Count the root moves left until there are none */
+void            PerftRootMoves(void)
+{
+    int             i;
+    while ((i = __atomic_fetch_add(&perft_next, 1, __ATOMIC_RELAXED)) < perft_movecnt) {
+        MakeMove(perft_moves[i]);
+        perft_counts[i] = perft_depth > 1 ? Perft(perft_depth - 1) : 1;
+        TakeBack();
+    }
+}
+
+/* A thread of its own on a copy of the root position */
+void           *PerftThink(void *arg)
+{
+    (void) arg;
+    memcpy(piece, root_piece, sizeof piece);
+    memcpy(color, root_color, sizeof color);
+    side = root_side;
+    hdp = 0;
+    ply = 0;
+    InitBitboards();
+    InitEval();
+    hash_key = ComputeHash();
+    pawn_key = ComputePawnHash();
+    PerftRootMoves();
+    return NULL;
+}
+
+/*
+   perft [-d] [-n] [-t N] [-H MB] depth, from the current position:
+   -d prints the count below each root move, -n makes the moves of the
+   last ply too, -t splits the root moves between N threads (default:
+   as many as the search uses) and -H uses a table of MB megabytes.
+   argv[0] is the command name.  Returns 0 on a usage error.
+ */
+int             RunPerft(int argc, char *argv[])
+{
+    int             i,
+                    divide = 0,
+                    nthreads = threads,
+                    mb = 0,
+                    workers = 0;
+    uint64_t        total = 0,
+                    entries = 1;
+    int64_t         start,
+                    ms;
+    pthread_t       worker[MAX_THREADS];
+    MOVE            moveBuf[200];
+    int             movecnt;
+    const char     *promotion_name[] = {"", "", "", "", "q", "r", "b", "n"};
+
+    perft_bulk = 1;
+    perft_depth = -1;
+    for (i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-d"))
+            divide = 1;
+        else if (!strcmp(argv[i], "-n"))
+            perft_bulk = 0;
+        else if (!strcmp(argv[i], "-t") && i + 1 < argc)
+            nthreads = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-H") && i + 1 < argc)
+            mb = atoi(argv[++i]);
+        else if (argv[i][0] >= '0' && argv[i][0] <= '9')
+            perft_depth = atoi(argv[i]);
+        else
+            perft_depth = -1, i = argc;
+    }
+    if (perft_depth < 0 || perft_depth >= MAX_PLY) {
+        printf("Usage: perft [-d] [-n] [-t threads] [-H MB] depth\n");
+        return 0;
+    }
+    if (nthreads < 1)
+        nthreads = 1;
+    if (nthreads > MAX_THREADS)
+        nthreads = MAX_THREADS;
+    if (mb > 0) {
+        while (entries * 2 * sizeof(PERFTHASH) <= (uint64_t) mb * 1024 * 1024)
+            entries *= 2;
+        if (!(perft_table = calloc(entries, sizeof(PERFTHASH))))
+            printf("Cannot allocate %d MB, counting without a table\n", mb);
+        perft_mask = entries - 1;
+    }
+    start = GetMs();
+    if (perft_depth == 0)
+        total = 1;
+    else {
+        /* the legal root moves, handed out one at a time */
+        perft_movecnt = 0;
+        movecnt = Gen(side, moveBuf);
+        for (i = 0; i < movecnt; ++i) {
+            if (MakeMove(moveBuf[i]))
+                perft_moves[perft_movecnt++] = moveBuf[i];
+            TakeBack();
+        }
+        perft_next = 0;
+        memcpy(root_piece, piece, sizeof root_piece);
+        memcpy(root_color, color, sizeof root_color);
+        root_side = side;
+        for (i = 1; i < nthreads && i < perft_movecnt; i++)
+            if (!pthread_create(&worker[workers], NULL, PerftThink, NULL))
+                workers++;
+        PerftRootMoves();
+        for (i = 0; i < workers; i++)
+            pthread_join(worker[i], NULL);
+        for (i = 0; i < perft_movecnt; i++) {
+            if (divide)
+                printf("%c%d%c%d%s: %llu\n",
+                       'a' + COL(perft_moves[i].from),
+                       8 - ROW(perft_moves[i].from),
+                       'a' + COL(perft_moves[i].dest),
+                       8 - ROW(perft_moves[i].dest),
+                       promotion_name[perft_moves[i].type],
+                       (unsigned long long) perft_counts[i]);
+            total += perft_counts[i];
+        }
+    }
+    ms = GetMs() - start;
+    free(perft_table);
+    perft_table = NULL;
+    printf("perft %d: %llu nodes, %lld ms, %llu nodes/s\n", perft_depth,
+           (unsigned long long) total, (long long) ms,
+           (unsigned long long) (total * 1000 / (ms > 0 ? ms : 1)));
+    return 1;
+}
+
+/* Split line into words for RunPerft(); returns how many went to argv */
+int             SplitArgs(char *line, char *argv[], int max)
+{
+    int             argc = 0;
+    char           *word = strtok(line, " \t\r\n");
+    while (word && argc < max) {
+        argv[argc++] = word;
+        word = strtok(NULL, " \t\r\n");
+    }
+    return argc;
+}
+
 /*
    ****************************************************************************
    * Utilities                                                                *
@@ -676,6 +1955,10 @@ void            initboard(void)
 {
     memcpy(piece, initial_piece, sizeof piece);
     memcpy(color, initial_color, sizeof color);
+    InitBitboards();
+    InitEval();
+    hash_key = ComputeHash();
+    pawn_key = ComputePawnHash();
 }
 
 /*
@@ -689,9 +1972,65 @@ int             nocomp = 0;
 int             no_go = 0;
 int             playing = 0;
 int             player = WHITE;
-int             maxtime = 1000;
 int             max_depth = 5;
-int             max_moves = 40;
+int             max_moves = 40;  /* moves per time control, 0 = whole game */
+int             time_inc = 0;    /* ms added to the clock after each move */
+int             fixed_time = 0;  /* st was given, ignore the clock */
+
+/*
+   Set the budgets of the next move, in ms.  Under a time control neither
+   may be 0, which would mean no limit, however little time is left.
+ */
+void            SetBudgets(int soft, int hard)
+{
+    time_hard = hard < 1 ? 1 : hard;
+    time_soft = soft < 1 ? 1 : soft > time_hard ? time_hard : soft;
+}
+
+/* Split the time left on our clock (ms) into the budgets of the next move */
+void            SetTimeBudget(int left)
+{
+    int             moves = MOVES_TO_GO,
+                    planned;
+    if (max_moves > 0)
+        moves = max_moves - (hdp / 2) % max_moves;
+    planned = left / moves + time_inc;
+    SetBudgets(planned / 2, 3 * planned > left / 2 ? left / 2 : 3 * planned);
+}
+
+/* st: the same number of seconds for every move, whatever the clock says */
+int             SetMoveTime(int seconds)
+{
+    if (seconds < 1)
+        return 0;
+    SetBudgets(seconds * 500, seconds * 1000);
+    fixed_time = true;
+    max_depth = 32;
+    return 1;
+}
+
+/*
+   level MOVES BASE INC, args being what follows "level": MOVES per time
+   control (0 = whole game), BASE minutes as "5" or "5:30", INC seconds.
+   A malformed line changes nothing and returns 0.
+ */
+int             SetLevel(const char *args)
+{
+    char            base[32];
+    int             moves,
+                    inc = 0,
+                    min = 0,
+                    sec = 0;
+    if (sscanf(args, "%d %31s %d", &moves, base, &inc) < 2
+        || sscanf(base, "%d:%d", &min, &sec) < 1)
+        return 0;
+    max_moves = moves;
+    time_inc = inc * 1000;
+    fixed_time = false;
+    max_depth = 32;
+    SetTimeBudget((min * 60 + sec) * 1000);
+    return 1;
+}
 
 /*
 Shamelessly cobbled start of a Winboard interface
@@ -769,7 +2108,7 @@ MOVE            getmove(int side, MOVE * moveBuf)
         } else if (!strcmp(cmd, "protover")) {
             printf("feature colors=1 myname=\"FirstChess Xboard 1.0\"");
             printf(" time=1 pause=0 ping=1 sigint=0 sigterm=0");
-            printf(" name=1 reuse=0 done=1\n");
+            printf(" name=1 reuse=0 memory=1 smp=1 done=1\n");
             continue;
         } else if (!strcmp(cmd, "force")) {
             nocomp = true;
@@ -788,30 +2127,45 @@ MOVE            getmove(int side, MOVE * moveBuf)
             printf("pong %d\n", ping);
             continue;
         } else if (!strcmp(cmd, "st")) {
-            scanf(inp, "st %d", &maxtime);
-            maxtime = (maxtime * 1000);
-            max_depth = 32;
+            int             seconds;
+            if (sscanf(inp, "st %d", &seconds) != 1 || !SetMoveTime(seconds))
+                printf("Error (bad st): %s", inp);
             continue;
         } else if (!strcmp(cmd, "time")) {
-            sscanf(inp, "time %d", &maxtime);
-            maxtime *= 14;
-            maxtime /= (TIMEALLOC);
-            max_depth = 15;
+            int             centis;
+            if (sscanf(inp, "time %d", &centis) == 1 && !fixed_time)
+                SetTimeBudget(centis * 10);
             continue;
         } else if (!strcmp(cmd, "level")) {
-            sscanf(inp, "level %d %d", &max_moves, &maxtime);
-            if (max_moves == 1);
-            max_moves = (TIMEALLOC / 1000);
-            maxtime *= 14;
-            maxtime /= (max_moves * 1000);
-            max_depth = 15;
+            if (!SetLevel(strstr(inp, cmd) + strlen(cmd)))
+                printf("Error (bad level): %s", inp);
             continue;
         } else if (!strcmp(cmd, "sd")) {
             sscanf(inp, "sd %d", &max_depth);
-            maxtime = 1 << 25;
             continue;
         } else if (!strcmp(cmd, "otim")) {
             continue;
+        } else if (!strcmp(cmd, "memory")) {
+            int             mb;
+            if (sscanf(inp, "memory %d", &mb) == 1 && !SetHashSize(mb))
+                printf("Error (cannot allocate %d MB): memory\n", mb);
+            continue;
+        } else if (!strcmp(cmd, "cores")) {
+            sscanf(inp, "cores %d", &threads);
+            if (threads < 1)
+                threads = 1;
+            if (threads > MAX_THREADS)
+                threads = MAX_THREADS;
+            continue;
+        } else if (!strcmp(cmd, "lmr") || !strcmp(cmd, "futility") || !strcmp(cmd, "razor")) {
+            int             on;
+            if (sscanf(inp, "%*s %d", &on) == 1)
+                SetPruning(cmd, on);
+            continue;
+        } else if (!strcmp(cmd, "perft")) {
+            char           *args[16];
+            RunPerft(SplitArgs(inp, args, 16), args);
+            continue;
         } else if (!strcmp(cmd, "result")) {
             char            result[256];
             sscanf(inp, "result %s", result);
@@ -877,7 +2231,7 @@ MOVE            getmove(int side, MOVE * moveBuf)
    * Main program                                                             *
    ****************************************************************************
  */
-int             main()
+int             main(int argc, char *argv[])
 {
     char            s[256];
     int             from,
@@ -886,12 +2240,21 @@ int             main()
     MOVE            moveBuf[200];
     int             movecnt;
 
-    printf("Help\n d: display board\n MOVE: make a move (e.g. b1c3, a7a8q)\n quit: exit\n\n");
     side = WHITE;
     computer_side = BLACK;      /* Human is white side */
     max_depth = 5;
     hdp = 0;
+    InitAttacks();
+    InitZobrist();
+    if (!SetHashSize(HASH_DEFAULT_MB)) {
+        printf("Cannot allocate the hash table\n");
+        return EXIT_FAILURE;
+    }
     initboard();
+    /* "firstchess perft ..." counts from the start position and exits */
+    if (argc > 1 && !strcmp(argv[1], "perft"))
+        return RunPerft(argc - 1, argv + 1) ? EXIT_SUCCESS : EXIT_FAILURE;
+    printf("Help\n d: display board\n MOVE: make a move (e.g. b1c3, a7a8q)\n memory N: use N MB for the hash table\n cores N: search with N threads\n lmr|futility|razor 0|1: switch a search reduction off or on\n st N: think N seconds a move\n time N: N centiseconds left on the clock\n level MOVES MIN[:SEC] INC: time control\n sd N: search at most N plies\n perft [-d] [-n] [-t N] [-H MB] depth: count the move tree\n quit: exit\n\n");
     for (;;) {
         if (side == computer_side) {    /* computer's turn */
             /* Find out the best move to react the current position */
@@ -911,6 +2274,56 @@ int             main()
             printf("Good bye!\n");
             return EXIT_SUCCESS;
         }
+        if (!strcmp(s, "memory")) {
+            int             mb;
+            if (scanf("%d", &mb) == 1 && !SetHashSize(mb))
+                printf("Cannot allocate %d MB\n", mb);
+            continue;
+        }
+        if (!strcmp(s, "cores")) {
+            if (scanf("%d", &threads) != 1 || threads < 1)
+                threads = 1;
+            if (threads > MAX_THREADS)
+                threads = MAX_THREADS;
+            continue;
+        }
+        if (!strcmp(s, "lmr") || !strcmp(s, "futility") || !strcmp(s, "razor")) {
+            int             on;
+            if (scanf("%d", &on) == 1)
+                SetPruning(s, on);
+            continue;
+        }
+        if (!strcmp(s, "st")) {
+            int             seconds;
+            if (scanf("%d", &seconds) != 1 || !SetMoveTime(seconds))
+                printf("Usage: st N, N at least 1\n");
+            continue;
+        }
+        if (!strcmp(s, "time")) {
+            int             centis;
+            if (scanf("%d", &centis) == 1 && !fixed_time)
+                SetTimeBudget(centis * 10);
+            continue;
+        }
+        if (!strcmp(s, "level")) {
+            char            line[256];
+            if (fgets(line, sizeof line, stdin) && !SetLevel(line))
+                printf("Usage: level MOVES MIN[:SEC] INC\n");
+            continue;
+        }
+        if (!strcmp(s, "sd")) {
+            if (scanf("%d", &max_depth) != 1 || max_depth < 1)
+                max_depth = 1;
+            continue;
+        }
+        if (!strcmp(s, "perft")) {
+            char            line[256],
+                           *args[16];
+            args[0] = s;
+            if (fgets(line, sizeof line, stdin))
+                RunPerft(1 + SplitArgs(line, args + 1, 15), args);
+            continue;
+        }
         /* maybe the user entered a move? */
         from = s[0] - 'a';
         from += 8 * (8 - (s[1] - '0'));